@@ -0,0 +1,150 @@
+#define _GNU_SOURCE
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pwd.h>
+
+#define REQUEST_MAX 512
+
+typedef struct {
+    const char *socket_path;
+    const char *name;
+    long requests;
+    long depth;
+    long ok;
+    long limited;
+    long failed;
+} Worker;
+
+void *runWorker(void *arg)
+{
+    Worker *w = arg;
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", w->socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr))) {
+        perror("connect");
+        w->failed = w->requests;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NULL;
+    }
+
+    char request[REQUEST_MAX];
+    char buf[65536];
+    char line[REQUEST_MAX * 4];
+    size_t line_len = 0;
+    long sent = 0, received = 0;
+
+    while (received < w->requests) {
+        while (sent < w->requests && sent - received < w->depth) {
+            int len = snprintf(request, sizeof(request),
+                    "{\"jsonrpc\":\"2.0\",\"id\":%ld,\"method\":\"get\",\"params\":{\"name\":\"%s\"}}\n",
+                    sent, w->name);
+            if (send(fd, request, len, MSG_NOSIGNAL) != len) {
+                perror("send");
+                close(fd);
+                w->failed += w->requests - received;
+                return NULL;
+            }
+            sent++;
+        }
+
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            close(fd);
+            w->failed += w->requests - received;
+            return NULL;
+        }
+        for (ssize_t i = 0; i < n; i++) {
+            if (buf[i] != '\n') {
+                if (line_len < sizeof(line) - 1) {
+                    line[line_len++] = buf[i];
+                }
+                continue;
+            }
+            line[line_len] = '\0';
+            if (strstr(line, "\"result\"") != NULL) {
+                w->ok++;
+            } else if (strstr(line, "\"code\":-32000") != NULL) {
+                w->limited++;
+            } else {
+                w->failed++;
+            }
+            line_len = 0;
+            received++;
+        }
+    }
+
+    close(fd);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argc > 6) {
+        fprintf(stderr, "Usage: %s NAME [CLIENTS] [REQUESTS] [DEPTH] [SOCKET]\n", argv[0]);
+        return 1;
+    }
+
+    long clients = argc > 2 ? strtol(argv[2], NULL, 10) : 8;
+    long requests = argc > 3 ? strtol(argv[3], NULL, 10) : 1000;
+    long depth = argc > 4 ? strtol(argv[4], NULL, 10) : 16;
+    char socket_path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+    if (argc > 5) {
+        snprintf(socket_path, sizeof(socket_path), "%s", argv[5]);
+    } else {
+        snprintf(socket_path, sizeof(socket_path), "%s/.config/p2/p2.sock", getpwuid(getuid())->pw_dir);
+    }
+    if (clients < 1 || requests < 1 || depth < 1) {
+        fprintf(stderr, "CLIENTS, REQUESTS and DEPTH must be positive\n");
+        return 1;
+    }
+
+    Worker *workers = calloc(clients, sizeof(*workers));
+    pthread_t *threads = calloc(clients, sizeof(*threads));
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < clients; i++) {
+        workers[i] = (Worker) {
+            .socket_path = socket_path,
+            .name = argv[1],
+            .requests = requests,
+            .depth = depth,
+        };
+        pthread_create(&threads[i], NULL, runWorker, &workers[i]);
+    }
+
+    long ok = 0, limited = 0, failed = 0;
+    for (long i = 0; i < clients; i++) {
+        pthread_join(threads[i], NULL);
+        ok += workers[i].ok;
+        limited += workers[i].limited;
+        failed += workers[i].failed;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    long total = ok + limited + failed;
+    printf("clients:      %ld\n", clients);
+    printf("requests:     %ld\n", total);
+    printf("ok:           %ld\n", ok);
+    printf("rate limited: %ld\n", limited);
+    printf("failed:       %ld\n", failed);
+    printf("elapsed:      %.3fs\n", elapsed);
+    printf("lookups:      %.0f ok/s\n", ok / elapsed);
+    printf("responses:    %.0f req/s\n", total / elapsed);
+
+    free(workers);
+    free(threads);
+    return failed > 0;
+}
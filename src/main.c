@@ -14,7 +14,8 @@ int main(const int argc, const char **argv)
 			"[NAME]");
 	copt_add_option("DELETE", "d", "delete", "Delete a password",
 			"[NAME]");
-	copt_add_option("PRINT", "p", "print", "Print a password", "[NAME]");
+	copt_add_option("PRINT", "p", "print", "Print a password",
+			"[NAME][@VERSION]");
 	copt_add_option("COPY", "c", "copy", "Copy a password to clipboard",
 			"[NAME]");
 	copt_add_option("RENAME", "r", "rename", "Rename a password",
@@ -22,6 +23,23 @@ int main(const int argc, const char **argv)
 	copt_add_option("BACKUP", "b", "backup",
 			"Backup password directory into a .tar", "[OUTPUT]");
     copt_add_option("RESTORE", "rs", "restore", "Restore passwords from .tar backup", "[BACKUP FILE]");
+	copt_add_option("UPDATE", "u", "update",
+			"Update a password, keeping the old one in its history",
+			"[NAME]");
+	copt_add_option("HISTORY", "hs", "history",
+			"List previous versions of a password", "[NAME]");
+	copt_add_option("SERVE", "s", "serve",
+			"Serve passwords over a JSON-RPC Unix socket, RATE requests per second per client (0 for unlimited)",
+			"[RATE]");
+	copt_add_option("ATTACH", "a", "attach", "Encrypt a file of any size",
+			"[NAME] [FILE]");
+	copt_add_option("EXTRACT", "x", "extract",
+			"Decrypt an attached file to stdout", "[NAME]");
+	copt_add_option("MIGRATE", "m", "migrate",
+			"Move every entry onto a wrapped vault key, with force leaving files that fail in the old format",
+			"[force]");
+	copt_add_option("PASSWD", "pw", "passwd", "Change the master password",
+			"");
 
     if (argc < 2) {
         printError("No subcommand given");
@@ -44,6 +62,20 @@ int main(const int argc, const char **argv)
         return cmdRename(argc, argv);
     } else if (copt_option_is("BACKUP", argc, argv)) {
         return cmdBackup(argc, argv);
+    } else if (copt_option_is("UPDATE", argc, argv)) {
+        return cmdUpdate(argc, argv);
+    } else if (copt_option_is("HISTORY", argc, argv)) {
+        return cmdHistory(argc, argv);
+    } else if (copt_option_is("SERVE", argc, argv)) {
+        return cmdServe(argc, argv);
+    } else if (copt_option_is("ATTACH", argc, argv)) {
+        return cmdAttach(argc, argv);
+    } else if (copt_option_is("EXTRACT", argc, argv)) {
+        return cmdExtract(argc, argv);
+    } else if (copt_option_is("MIGRATE", argc, argv)) {
+        return cmdMigrate(argc, argv);
+    } else if (copt_option_is("PASSWD", argc, argv)) {
+        return cmdPasswd(argc, argv);
     } else if (copt_option_is("RESTORE", argc, argv)) {
         //TODO
         // return cmdRestore(argc, argv);
@@ -1,5 +1,18 @@
+#define _GNU_SOURCE
+
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
 #include <sodium.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -17,6 +30,32 @@
 
 #define PASSWORD_MAX 4096
 #define EXTENSION_LOCKED ".locked"
+#define EXTENSION_HISTORY ".history"
+#define EXTENSION_TMP ".tmp"
+#define EXTENSION_ATTACHMENT ".attachment"
+#define ATTACHMENT_CHUNK (1 << 20)
+
+#define VAULT_BATCH 256
+#define VAULT_THREADS 8
+#define VAULT_READ_MAX (1 << 20)
+#define VAULT_HEADER "vault.header"
+#define VAULT_KDF_CONTEXT "p2entry_"
+#define VAULT_KEY_ID_BYTES 8
+#define EXTENSION_PENDING ".pending"
+#define VAULT_LEGACY "vault.legacy"
+#define HISTORY_MAX 16
+#define HISTORY_COMPACT (HISTORY_MAX * 2)
+#define HISTORY_RECORD_LINES 4
+
+#define SERVE_SOCKET "p2.sock"
+#define SERVE_EVENTS_MAX 64
+#define SERVE_CLIENTS_MAX 1024
+#define SERVE_REQUEST_MAX 4096
+#define SERVE_ID_MAX 64
+#define SERVE_OUTPUT_MAX (1 << 20)
+#define SERVE_RATE 1000
+#define SERVE_BURST_SECONDS 2
+#define SERVE_BUCKETS_MAX (SERVE_CLIENTS_MAX * 2)
 
 #define ERROR  "\033[31;1;3m[ERROR] \033[0m"
 #define INFO   "\033[36;1;3m[INFO]  \033[0m"
@@ -29,9 +68,152 @@
         (void) (a); \
     } while(0)
 
+typedef struct {
+    int legacy;
+    int fallback;
+    unsigned char key[crypto_kdf_KEYBYTES];
+    unsigned char legacy_key[crypto_kdf_KEYBYTES];
+} VaultKey;
+
+typedef struct {
+    char *path;
+    int has_timestamp;
+    int is_attachment;
+    int status;
+    unsigned char *data;
+    size_t data_len;
+} MigrateFile;
+
+typedef struct {
+    MigrateFile *files;
+    size_t files_size;
+    size_t capacity;
+    char **legacy_names;
+    size_t legacy_names_size;
+    int retrying;
+} MigrateList;
+
+typedef struct {
+    const VaultKey *legacy_key;
+    const VaultKey *vault_key;
+} MigrateKeys;
+
+typedef struct {
+    int in_fd;
+    int out_fd;
+    int status;
+    const VaultKey *vault_key;
+} MigratePipe;
+
+typedef struct {
+    char *name;
+    int loaded;
+    unsigned char nonce[crypto_secretbox_NONCEBYTES];
+    unsigned char *ciphertext;
+    size_t ciphertext_size;
+} ServeEntry;
+
+typedef struct {
+    ServeEntry *entries;
+    size_t entries_size;
+    size_t entries_cap;
+} ServeIndex;
+
+typedef struct {
+    pid_t pid;
+    size_t clients;
+    double tokens;
+    struct timespec last;
+} ServeBucket;
+
+typedef struct {
+    int fd;
+    uint32_t events;
+    int closing;
+    char in[SERVE_REQUEST_MAX];
+    size_t in_len;
+    char *out;
+    size_t out_len;
+    size_t out_sent;
+    size_t out_cap;
+    ServeBucket *bucket;
+} ServeClient;
+
+typedef struct {
+    int epfd;
+    int listen_fd;
+    int inotify_fd;
+    size_t clients_size;
+    long rate;
+    ServeBucket buckets[SERVE_BUCKETS_MAX];
+    char *config_path;
+    ServeIndex index;
+    VaultKey key;
+} ServeState;
+
+typedef struct {
+    char *name;
+    char *path;
+    int fd;
+    int error;
+    struct statx stx;
+    unsigned char *data;
+    size_t data_len;
+} VaultFile;
+
+typedef int (*VaultCallback)(VaultFile *file, void *ctx);
+
+typedef enum {
+    VAULT_OP_OPEN,
+    VAULT_OP_STATX,
+    VAULT_OP_READ,
+    VAULT_OP_CLOSE,
+} VaultOp;
+
+typedef struct {
+    int fd;
+    unsigned sq_entries;
+    unsigned pending;
+    unsigned inflight;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_size;
+    size_t cq_size;
+    size_t sqes_size;
+} VaultRing;
+
+typedef void (*WorkCallback)(void *item, void *ctx);
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    pthread_t threads[VAULT_THREADS];
+    size_t threads_size;
+    WorkCallback callback;
+    void *ctx;
+    char *items;
+    size_t item_size;
+    size_t items_size;
+    size_t next;
+    size_t busy;
+    unsigned long generation;
+    int stop;
+} WorkPool;
+
 void printError(const char *fmt, ...);
 void printInfo(const char *fmt, ...);
 void memWipe(void *p, int len);
+void fdWipe(int fd);
 void fileWipe(const char *path);
 void mkConfigDir();
 char *getConfigPath();
@@ -39,8 +221,87 @@ void printDirContents(char *path);
 void printBaseName(char *name);
 char *getPassPhrase(const char *prompt);
 char *getNewPath(const char *path_prefix, const char *name, const char *extension);
-void writeDataToFile(const char *path, const unsigned char *nonce, const size_t nonce_size, const unsigned char *ciphertext, const size_t ciphertext_size);
+void writeHex(FILE *fileptr, const unsigned char *hex_arr, const size_t hex_arr_size);
+void writeData(FILE *fileptr, const unsigned char *nonce, const size_t nonce_size, const unsigned char *ciphertext, const size_t ciphertext_size);
+int writeDataToFile(const char *path, const unsigned char *nonce, const size_t nonce_size, const unsigned char *ciphertext, const size_t ciphertext_size);
+int readData(FILE *fileptr, unsigned char *nonce, const size_t nonce_size, unsigned char **ciphertext, size_t *ciphertext_size);
 void readHexFromStr(unsigned char *hex_arr, const long int hex_arr_size, const char *str);
+int hasExtension(const char *name, const char *extension);
+long splitVersion(char *name);
+void skipLines(FILE *fptr, size_t n);
+size_t countHistory(const char *history_path);
+int compactHistory(const char *history_path);
+int appendHistory(const char *locked_path, const char *history_path);
+FILE *openVersion(const char *name, const long version);
+int serveIndexCompare(const void *a, const void *b);
+void serveIndexFree(ServeIndex *index);
+int serveIndexAdd(VaultFile *file, void *ctx);
+int serveIndexBuild(ServeIndex *index, const char *config_path);
+ServeEntry *serveIndexFind(ServeIndex *index, const char *config_path, const char *name);
+size_t serveIndexLowerBound(const ServeIndex *index, const char *name);
+void serveIndexInvalidate(ServeIndex *index, const char *name);
+void serveIndexRemove(ServeIndex *index, const char *name);
+void serveIndexWatch(ServeState *state);
+void serveAppend(ServeClient *client, const char *data, size_t len);
+void serveAppendJsonString(ServeClient *client, const char *str, size_t len);
+void serveAppendHead(ServeClient *client, const char *id);
+void serveAppendError(ServeClient *client, const char *id, int code, const char *message);
+const char *jsonFindKey(const char *json, const char *key);
+int jsonGetString(const char *json, const char *key, char *out, size_t out_size);
+void jsonGetId(const char *json, char *out, size_t out_size);
+void serveBucketRefill(ServeBucket *bucket, long rate);
+ServeBucket *serveBucketAcquire(ServeState *state, pid_t pid);
+int serveRateLimit(ServeBucket *bucket, long rate);
+void serveHandleGet(ServeState *state, ServeClient *client, const char *request, const char *id);
+void serveHandleList(ServeState *state, ServeClient *client, const char *id);
+void serveHandleRequest(ServeState *state, ServeClient *client, const char *request);
+void serveClientClose(ServeState *state, ServeClient *client);
+int serveClientFlush(ServeState *state, ServeClient *client);
+size_t servePending(const ServeClient *client);
+void serveClientProcess(ServeState *state, ServeClient *client);
+int serveClientRead(ServeState *state, ServeClient *client);
+void serveAccept(ServeState *state);
+int serveListen(const char *socket_path);
+void serveStop(int sig);
+ssize_t readFull(int fd, unsigned char *buf, size_t len);
+int writeFull(int fd, const unsigned char *buf, size_t len);
+int attachEncrypt(int in_fd, int out_fd, const VaultKey *vault_key);
+int attachDecrypt(int in_fd, int out_fd, const VaultKey *vault_key);
+int vaultRingInit(VaultRing *ring, unsigned entries);
+void vaultRingFree(VaultRing *ring);
+struct io_uring_sqe *vaultRingSqe(VaultRing *ring, VaultOp op, size_t i);
+int vaultRingWait(VaultRing *ring, VaultFile *files);
+int vaultRingBatch(VaultRing *ring, VaultFile *files, size_t files_size);
+void vaultReadFile(VaultFile *file);
+void vaultReadWork(void *item, void *ctx);
+void workPoolDrain(WorkPool *pool);
+void *workPoolThread(void *arg);
+void workPoolInit(WorkPool *pool);
+void workPoolRun(WorkPool *pool, void *items, size_t item_size, size_t items_size, WorkCallback callback, void *ctx);
+void workPoolFree(WorkPool *pool);
+int vaultScan(const char *dir_path, const char *extension, VaultCallback callback, void *ctx);
+int vaultHeaderWrite(const char *path, const char *password, size_t password_len, const unsigned char *master_key);
+int vaultHeaderRead(const char *path, const char *password, size_t password_len, unsigned char *master_key);
+int vaultIsEmpty(const char *config_path);
+int vaultKeyUnlock(VaultKey *vault_key, const char *password, size_t password_len, int create);
+void vaultKeyDerive(const VaultKey *vault_key, const unsigned char *id, unsigned char *key, size_t key_size);
+int vaultKeyOpen(const VaultKey *vault_key, unsigned char *decrypted, const unsigned char *ciphertext, size_t ciphertext_size, const unsigned char *nonce);
+void vaultKeyLegacy(const VaultKey *vault_key, VaultKey *legacy_key);
+int vaultKeyCheck(const VaultKey *vault_key, const char *config_path);
+FILE *migrateOpen(const MigrateFile *file);
+int migrateRecords(MigrateFile *file, const VaultKey *legacy_key, const VaultKey *vault_key);
+int attachProbe(int fd, const VaultKey *vault_key);
+void *migrateAttachmentWriter(void *arg);
+int migrateAttachment(MigrateFile *file, const VaultKey *legacy_key, const VaultKey *vault_key);
+int migrateCheck(MigrateFile *file, const VaultKey *legacy_key, const VaultKey *vault_key);
+void migrateWork(void *item, void *ctx);
+void migrateBaseName(const char *path, char *name, size_t name_size);
+int migrateWriteLegacy(const char *legacy_path, const MigrateFile *files, size_t files_size);
+char **migrateReadLegacy(const char *legacy_path, size_t *names_size);
+int migrateListed(char **names, size_t names_size, const char *name);
+int migrateRenameLegacy(const char *from, const char *to);
+MigrateFile *migrateAdd(MigrateList *list, const char *path, const char *name);
+int migrateCollect(VaultFile *file, void *ctx);
 
 int cmdHelp(const int argc, const char **argv);
 int cmdVersion(const int argc, const char **argv);
@@ -50,6 +311,13 @@ int cmdPrint(const int argc, const char **argv);
 int cmdDelete(const int argc, const char **argv);
 int cmdCopy(const int argc, const char **argv);
 int cmdRename(const int argc, const char **argv);
+int cmdUpdate(const int argc, const char **argv);
+int cmdHistory(const int argc, const char **argv);
+int cmdServe(const int argc, const char **argv);
+int cmdAttach(const int argc, const char **argv);
+int cmdExtract(const int argc, const char **argv);
+int cmdMigrate(const int argc, const char **argv);
+int cmdPasswd(const int argc, const char **argv);
 
 void printError(const char *fmt, ...)
 {
@@ -75,15 +343,30 @@ void memWipe(void *p, int len)
     memset(p, 0, len);
 }
 
-void fileWipe(const char *path)
+void fdWipe(int fd)
 {
     struct stat st;
-    stat(path, &st);
-    FILE *fptr = fopen(path, "w");
-    for (int i = 0; i < st.st_size; i++) {
-        fprintf(fptr, "%c", 0);
+    if (fstat(fd, &st)) {
+        return;
     }
-    fclose(fptr);
+    static const char zeros[BUFSIZ];
+    for (off_t i = 0; i < st.st_size; i += sizeof(zeros)) {
+        size_t n = st.st_size - i < (off_t) sizeof(zeros) ? (size_t) (st.st_size - i) : sizeof(zeros);
+        if (pwrite(fd, zeros, n, i) < 0) {
+            return;
+        }
+    }
+    fsync(fd);
+}
+
+void fileWipe(const char *path)
+{
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    fdWipe(fd);
+    close(fd);
 }
 
 void mkConfigDir()
@@ -128,40 +411,90 @@ char *getNewPath(const char *path_prefix, const char *name, const char *extensio
     return path;
 }
 
-void writeDataToFile(const char *path, const unsigned char *nonce, const size_t nonce_size, const unsigned char *ciphertext, const size_t ciphertext_size)
+void writeHex(FILE *fileptr, const unsigned char *hex_arr, const size_t hex_arr_size)
 {
-    FILE *fileptr;
-    fileptr = fopen(path, "w");
-    for (size_t i = 0; i < nonce_size; i++) {
-        fprintf(fileptr, "%X", nonce[i]);
-        if (i < nonce_size - 1) {
+    for (size_t i = 0; i < hex_arr_size; i++) {
+        fprintf(fileptr, "%X", hex_arr[i]);
+        if (i < hex_arr_size - 1) {
             fprintf(fileptr, " ");
         }
     }
     fprintf(fileptr, "\n");
+}
+
+void writeData(FILE *fileptr, const unsigned char *nonce, const size_t nonce_size, const unsigned char *ciphertext, const size_t ciphertext_size)
+{
+    writeHex(fileptr, nonce, nonce_size);
     fprintf(fileptr, "%ld\n", ciphertext_size);
-    for (size_t i = 0; i < ciphertext_size; i++) {
-        fprintf(fileptr, "%X", ciphertext[i]);
-        if (i < ciphertext_size - 1) {
-            fprintf(fileptr, " ");
-        }
+    writeHex(fileptr, ciphertext, ciphertext_size);
+}
+
+int writeDataToFile(const char *path, const unsigned char *nonce, const size_t nonce_size, const unsigned char *ciphertext, const size_t ciphertext_size)
+{
+    char tmp_path[FILENAME_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s%s", path, EXTENSION_TMP);
+    FILE *fileptr = fopen(tmp_path, "w");
+    if (fileptr == NULL) {
+        return 1;
     }
-    fprintf(fileptr, "\n");
-    fclose(fileptr);
+    fchmod(fileno(fileptr), 0600);
+    writeData(fileptr, nonce, nonce_size, ciphertext, ciphertext_size);
+
+    int failed = fflush(fileptr) || fsync(fileno(fileptr));
+    if (fclose(fileptr) || failed || rename(tmp_path, path)) {
+        unlink(tmp_path);
+        return 1;
+    }
+    return 0;
+}
+
+int readData(FILE *fileptr, unsigned char *nonce, const size_t nonce_size, unsigned char **ciphertext, size_t *ciphertext_size)
+{
+    char *line = NULL;
+    size_t line_len = 0;
+
+    if (getline(&line, &line_len, fileptr) == -1) {
+        free(line);
+        return 1;
+    }
+    readHexFromStr(nonce, nonce_size, line);
+
+    if (getline(&line, &line_len, fileptr) == -1) {
+        free(line);
+        return 1;
+    }
+    long size = strtol(line, NULL, 10);
+    if (size < (long) crypto_secretbox_MACBYTES) {
+        free(line);
+        return 1;
+    }
+    *ciphertext_size = size;
+
+    if (getline(&line, &line_len, fileptr) == -1) {
+        free(line);
+        return 1;
+    }
+    *ciphertext = (unsigned char *) malloc(*ciphertext_size);
+    readHexFromStr(*ciphertext, *ciphertext_size, line);
+
+    free(line);
+    return 0;
 }
 
 void readHexFromStr(unsigned char *hex_arr, const long int hex_arr_size, const char *str)
 {
     int i = 0, j = 0;
+    unsigned int byte;
     while (j < hex_arr_size) {
         if (*(str+i) != ' ') {
             if (*(str+i+1) != ' ') {
-                sscanf(str+i, "%2X", (unsigned int *) &hex_arr[j]);
+                sscanf(str+i, "%2X", &byte);
                 i += 3;
             } else {
-                sscanf(str+i, "%X", (unsigned int *) &hex_arr[j]);
+                sscanf(str+i, "%X", &byte);
                 i += 2;
             }
+            hex_arr[j] = byte;
         } else {
             i++;
         }
@@ -169,6 +502,164 @@ void readHexFromStr(unsigned char *hex_arr, const long int hex_arr_size, const c
     }
 }
 
+int hasExtension(const char *name, const char *extension)
+{
+    size_t name_len = strlen(name);
+    size_t extension_len = strlen(extension);
+    return name_len > extension_len && !strcmp(name + name_len - extension_len, extension);
+}
+
+long splitVersion(char *name)
+{
+    char *at = strrchr(name, '@');
+    if (at == NULL) {
+        return 0;
+    }
+
+    if (at[1] == '\0' || strspn(at + 1, "0123456789") != strlen(at + 1)) {
+        return 0;
+    }
+    long version = strtol(at + 1, NULL, 10);
+    *at = '\0';
+    return version;
+}
+
+void skipLines(FILE *fptr, size_t n)
+{
+    int c;
+    while (n > 0 && (c = getc(fptr)) != EOF) {
+        if (c == '\n') {
+            n--;
+        }
+    }
+}
+
+size_t countHistory(const char *history_path)
+{
+    FILE *fptr = fopen(history_path, "r");
+    if (fptr == NULL) {
+        return 0;
+    }
+
+    size_t lines = 0;
+    int c;
+    while ((c = getc(fptr)) != EOF) {
+        if (c == '\n') {
+            lines++;
+        }
+    }
+    fclose(fptr);
+    return lines / HISTORY_RECORD_LINES;
+}
+
+int compactHistory(const char *history_path)
+{
+    size_t count = countHistory(history_path);
+    if (count < HISTORY_COMPACT) {
+        return 0;
+    }
+
+    char tmp_path[FILENAME_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s%s", history_path, EXTENSION_TMP);
+
+    FILE *in = fopen(history_path, "r");
+    FILE *out = fopen(tmp_path, "w");
+    if (in == NULL || out == NULL) {
+        if (in != NULL) {
+            fclose(in);
+        }
+        if (out != NULL) {
+            fclose(out);
+        }
+        return 1;
+    }
+    fchmod(fileno(out), 0600);
+
+    skipLines(in, (count - HISTORY_MAX) * HISTORY_RECORD_LINES);
+    char buf[BUFSIZ];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        fwrite(buf, 1, n, out);
+    }
+    fclose(in);
+
+    int old_fd = open(history_path, O_WRONLY | O_CLOEXEC);
+    int failed = fflush(out) || fsync(fileno(out));
+    if (fclose(out) || failed || rename(tmp_path, history_path)) {
+        unlink(tmp_path);
+        if (old_fd >= 0) {
+            close(old_fd);
+        }
+        return 1;
+    }
+    if (old_fd >= 0) {
+        fdWipe(old_fd);
+        close(old_fd);
+    }
+    return 0;
+}
+
+int appendHistory(const char *locked_path, const char *history_path)
+{
+    struct stat st;
+    if (stat(locked_path, &st)) {
+        return 1;
+    }
+
+    FILE *in = fopen(locked_path, "r");
+    FILE *out = fopen(history_path, "a");
+    if (in == NULL || out == NULL) {
+        if (in != NULL) {
+            fclose(in);
+        }
+        if (out != NULL) {
+            fclose(out);
+        }
+        return 1;
+    }
+    fchmod(fileno(out), 0600);
+
+    fprintf(out, "%ld\n", (long) st.st_mtime);
+    char buf[BUFSIZ];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        fwrite(buf, 1, n, out);
+    }
+    fclose(in);
+    int failed = fflush(out) || fsync(fileno(out));
+    if (fclose(out) || failed) {
+        return 1;
+    }
+
+    return compactHistory(history_path);
+}
+
+FILE *openVersion(const char *name, const long version)
+{
+    char *config_path = getConfigPath();
+    FILE *fptr = NULL;
+
+    if (version == 0) {
+        char *locked_path = getNewPath(config_path, name, EXTENSION_LOCKED);
+        fptr = fopen(locked_path, "r");
+        free(locked_path);
+        free(config_path);
+        return fptr;
+    }
+
+    char *history_path = getNewPath(config_path, name, EXTENSION_HISTORY);
+    size_t count = countHistory(history_path);
+    if ((size_t) version <= count && version <= HISTORY_MAX) {
+        fptr = fopen(history_path, "r");
+    }
+    if (fptr != NULL) {
+        skipLines(fptr, (count - version) * HISTORY_RECORD_LINES + 1);
+    }
+    free(history_path);
+    free(config_path);
+    return fptr;
+}
+
 char *getConfigPath()
 {
     char *config_path = (char *) malloc(sizeof(*config_path) * FILENAME_MAX);
@@ -237,9 +728,13 @@ int cmdList(const int argc, const char **argv)
     printf("Contents of '%s':\n", path);
     size_t i = 0;
     while ((entity = readdir(dir)) != NULL) {
-        if (strcmp(entity->d_name, ".") != 0 && strcmp(entity->d_name, "..") != 0) {
+        if (hasExtension(entity->d_name, EXTENSION_LOCKED)) {
             printBaseName(entity->d_name);
             i++;
+        } else if (hasExtension(entity->d_name, EXTENSION_ATTACHMENT)) {
+            int name_len = strlen(entity->d_name) - strlen(EXTENSION_ATTACHMENT);
+            printf("\t"ITALIC_BOLD_BLUE"%.*s"COLOR_RESET"\t(attachment)\n", name_len, entity->d_name);
+            i++;
         }
     }
     closedir(dir);
@@ -268,6 +763,15 @@ int cmdNew(const int argc, const char **argv)
         return 1;
     }
 
+    char *attachment_path = getNewPath(getConfigPath(), argv[2], EXTENSION_ATTACHMENT);
+    if (!stat(attachment_path, &st)) {
+        printError("Invalid name: '%s'. File '%s' already exists", argv[2], attachment_path);
+        free(new_path);
+        free(attachment_path);
+        return 1;
+    }
+    free(attachment_path);
+
     char *plaintext = getPassPhrase("Enter password: ");
     char *password = getPassPhrase("Master password: ");
 
@@ -291,19 +795,35 @@ int cmdNew(const int argc, const char **argv)
         return 1;
     }
 
-    crypto_generichash(key, sizeof(key), (unsigned char *)password, password_len, NULL, 0);
+    VaultKey vault_key;
+    if (vaultKeyUnlock(&vault_key, password, password_len, 1)) {
+        printError("Decryption failed");
+        memWipe(&vault_key, sizeof(vault_key));
+        memWipe(plaintext, sizeof(*plaintext) * plaintext_len);
+        memWipe(password, sizeof(*password) * password_len);
+        free(new_path);
+        free(plaintext);
+        free(password);
+        return 1;
+    }
 
     randombytes_buf(nonce, sizeof(nonce));
+    vaultKeyDerive(&vault_key, nonce, key, key_size);
+    memWipe(&vault_key, sizeof(vault_key));
     crypto_secretbox_easy(ciphertext, (unsigned char *)plaintext, plaintext_len, nonce, key);
 
-    writeDataToFile(new_path, nonce, nonce_size, ciphertext, ciphertext_size);
+    int failed = writeDataToFile(new_path, nonce, nonce_size, ciphertext, ciphertext_size);
+    if (failed) {
+        printError("Could not write '%s'", new_path);
+    }
 
     memWipe(plaintext, sizeof(*plaintext) * plaintext_len);
     memWipe(password, sizeof(*password) * password_len);
+    memWipe(key, key_size);
     free(new_path);
     free(plaintext);
     free(password);
-    return 0;
+    return failed;
 }
 
 int cmdPrint(const int argc, const char **argv)
@@ -315,39 +835,50 @@ int cmdPrint(const int argc, const char **argv)
 
     mkConfigDir();
 
-    char *print_path = getNewPath(getConfigPath(), argv[2], EXTENSION_LOCKED);
+    char name[FILENAME_MAX];
+    snprintf(name, sizeof(name), "%s", argv[2]);
+    long version = 0;
+
+    char *print_path = getNewPath(getConfigPath(), name, EXTENSION_LOCKED);
     struct stat st;
     if (stat(print_path, &st)) {
-        printError("Invalid name: '%s'. File '%s' does not exist", argv[2], print_path);
+        free(print_path);
+        version = splitVersion(name);
+        print_path = getNewPath(getConfigPath(), name, EXTENSION_LOCKED);
+    }
+    if (stat(print_path, &st)) {
+        char *attach_path = getNewPath(getConfigPath(), argv[2], EXTENSION_ATTACHMENT);
+        if (!stat(attach_path, &st)) {
+            printError("'%s' is an attachment. Use `%s extract %s`", argv[2], program.name, argv[2]);
+        } else {
+            printError("Invalid name: '%s'. File '%s' does not exist", name, print_path);
+        }
+        free(attach_path);
+        free(print_path);
+        return 1;
+    }
+
+    FILE *fptr = openVersion(name, version);
+    if (fptr == NULL) {
+        printError("Invalid version: '%s' has no version %ld", name, version);
         free(print_path);
         return 1;
     }
 
-    char *line = (char *) malloc(sizeof(*line) * PASSWORD_MAX);
-    size_t line_len = 0;
     size_t nonce_size = crypto_secretbox_NONCEBYTES;
     size_t ciphertext_size;
-    size_t key_size = crypto_secretbox_KEYBYTES;
-    unsigned char key[key_size];
-
-    FILE *fptr;
-    fptr = fopen(print_path, "r");
-    char *str_nonce = (char *) malloc(nonce_size);
-    (void)!getline(&str_nonce, &line_len, fptr);
-
-    (void)!getline(&line, &line_len, fptr);
-    ciphertext_size = strtol(line, NULL, 10);
-    size_t plaintext_len = ciphertext_size - crypto_secretbox_MACBYTES;
+    unsigned char nonce[nonce_size];
+    unsigned char *ciphertext = NULL;
 
-    char *str_ciphertext = (char *) malloc(sizeof(*str_ciphertext) * PASSWORD_MAX);
-    (void)!getline(&str_ciphertext, &line_len, fptr);
+    if (readData(fptr, nonce, nonce_size, &ciphertext, &ciphertext_size)) {
+        printError("Could not read '%s'", argv[2]);
+        fclose(fptr);
+        free(print_path);
+        free(ciphertext);
+        return 1;
+    }
     fclose(fptr);
-
-    unsigned char *nonce = (unsigned char *) malloc(nonce_size);
-    unsigned char *ciphertext = (unsigned char *) malloc(ciphertext_size);
-
-    readHexFromStr(nonce, nonce_size, str_nonce);
-    readHexFromStr(ciphertext, ciphertext_size, str_ciphertext);
+    size_t plaintext_len = ciphertext_size - crypto_secretbox_MACBYTES;
 
     char *password = getPassPhrase("Master password: ");
     size_t password_len = strlen(password);
@@ -355,33 +886,27 @@ int cmdPrint(const int argc, const char **argv)
     if (sodium_init() < 0) {
         printError("Sodium could not init in '%s'", __func__);
         memWipe(password, sizeof(*password) * password_len);
-        memWipe(key, key_size);
         free(password);
         free(print_path);
-        free(line);
-        free(str_nonce);
-        free(str_ciphertext);
-        free(nonce);
+        free(ciphertext);
         return 1;
     }
 
-    crypto_generichash(key, sizeof(key), (unsigned char *)password, password_len, NULL, 0);
-
+    VaultKey vault_key;
     unsigned char decrypted[plaintext_len];
-    if (crypto_secretbox_open_easy(decrypted, ciphertext, ciphertext_size, nonce, key) != 0) {
+    int locked = vaultKeyUnlock(&vault_key, password, password_len, 0);
+    int failed = locked || vaultKeyOpen(&vault_key, decrypted, ciphertext, ciphertext_size, nonce);
+    memWipe(&vault_key, sizeof(vault_key));
+
+    if (failed) {
         memWipe(password, sizeof(*password) * password_len);
-        memWipe(key, key_size);
         free(password);
         free(print_path);
-        free(line);
-        free(str_nonce);
-        free(str_ciphertext);
-        free(nonce);
+        free(ciphertext);
         printError("Decryption failed");
         return 1;
     }
     memWipe(password, sizeof(*password) * password_len);
-    memWipe(key, key_size);
 
     for (size_t i = 0; i < plaintext_len; i++) {
         printf("%c", decrypted[i]);
@@ -391,10 +916,7 @@ int cmdPrint(const int argc, const char **argv)
     memWipe(decrypted, sizeof(*decrypted) * plaintext_len);
     free(password);
     free(print_path);
-    free(line);
-    free(str_nonce);
-    free(str_ciphertext);
-    free(nonce);
+    free(ciphertext);
     return 0;
 }
 
@@ -408,26 +930,39 @@ int cmdDelete(const int argc, const char **argv)
     mkConfigDir();
 
     char *remove_path = getNewPath(getConfigPath(), argv[2], EXTENSION_LOCKED);
+    char *attachment_path = getNewPath(getConfigPath(), argv[2], EXTENSION_ATTACHMENT);
     struct stat st;
-    if (stat(remove_path, &st)) {
+    if (stat(remove_path, &st) && stat(attachment_path, &st)) {
         printError("Invalid name: '%s'. File '%s' does not exist", argv[2], remove_path);
         free(remove_path);
+        free(attachment_path);
         return 1;
     }
 
-    printInfo("Are you sure you want to remove '%s'?\n", remove_path);
+    printInfo("Are you sure you want to remove '%s'?\n", argv[2]);
     printInfo("You will not be able to recover the data. Remove? [y/N] ");
     char a = '\0';
     a = getchar();
     if (a != 'y' && a != 'Y') {
         printError("Aborting deletion");
+        free(remove_path);
+        free(attachment_path);
         return 1;
     }
 
-    fileWipe(remove_path);
-    remove(remove_path);
-    printInfo("Removed file: '%s'\n", remove_path);
+    char *history_path = getNewPath(getConfigPath(), argv[2], EXTENSION_HISTORY);
+    const char *paths[] = { remove_path, history_path, attachment_path };
+    for (size_t i = 0; i < sizeof(paths) / sizeof(*paths); i++) {
+        if (!stat(paths[i], &st)) {
+            fileWipe(paths[i]);
+            remove(paths[i]);
+            printInfo("Removed file: '%s'\n", paths[i]);
+        }
+    }
 
+    free(remove_path);
+    free(history_path);
+    free(attachment_path);
     return 0;
 }
 
@@ -452,8 +987,6 @@ int cmdCopy(const int argc, const char **argv)
     size_t line_len = 0;
     size_t nonce_size = crypto_secretbox_NONCEBYTES;
     size_t ciphertext_size;
-    size_t key_size = crypto_secretbox_KEYBYTES;
-    unsigned char key[key_size];
 
     FILE *fptr;
     fptr = fopen(copy_path, "r");
@@ -480,7 +1013,6 @@ int cmdCopy(const int argc, const char **argv)
     if (sodium_init() < 0) {
         printError("Sodium could not init in '%s'", __func__);
         memWipe(password, sizeof(*password) * password_len);
-        memWipe(key, key_size);
         free(password);
         free(copy_path);
         free(line);
@@ -490,12 +1022,14 @@ int cmdCopy(const int argc, const char **argv)
         return 1;
     }
 
-    crypto_generichash(key, sizeof(key), (unsigned char *)password, password_len, NULL, 0);
-
+    VaultKey vault_key;
     unsigned char decrypted[plaintext_len];
-    if (crypto_secretbox_open_easy(decrypted, ciphertext, ciphertext_size, nonce, key) != 0) {
+    int locked = vaultKeyUnlock(&vault_key, password, password_len, 0);
+    int failed = locked || vaultKeyOpen(&vault_key, decrypted, ciphertext, ciphertext_size, nonce);
+    memWipe(&vault_key, sizeof(vault_key));
+
+    if (failed) {
         memWipe(password, sizeof(*password) * password_len);
-        memWipe(key, key_size);
         free(password);
         free(copy_path);
         free(line);
@@ -506,7 +1040,6 @@ int cmdCopy(const int argc, const char **argv)
         return 1;
     }
     memWipe(password, sizeof(*password) * password_len);
-    memWipe(key, key_size);
 
     char filename_out[FILENAME_MAX];
     struct timeval time;
@@ -539,27 +1072,2358 @@ int cmdRename(const int argc, const char **argv)
         return 1;
     }
 
-    char *rename_path = getNewPath(getConfigPath(), argv[2], EXTENSION_LOCKED);
+    const char *extensions[] = { EXTENSION_LOCKED, EXTENSION_ATTACHMENT, EXTENSION_HISTORY };
+    const size_t extensions_size = sizeof(extensions) / sizeof(*extensions);
+    char *rename_paths[extensions_size];
+    char *new_paths[extensions_size];
+    int exists[extensions_size];
+    int found = 0;
+    char *taken = NULL;
     struct stat st;
-    if (stat(rename_path, &st)) {
-        printError("Invalid name: '%s'. File '%s' does not exist", argv[2], rename_path);
-        free(rename_path);
+    for (size_t i = 0; i < extensions_size; i++) {
+        rename_paths[i] = getNewPath(getConfigPath(), argv[2], extensions[i]);
+        new_paths[i] = getNewPath(getConfigPath(), argv[3], extensions[i]);
+        exists[i] = !stat(rename_paths[i], &st);
+        found |= exists[i];
+        if (taken == NULL && !stat(new_paths[i], &st)) {
+            taken = new_paths[i];
+        }
+    }
+
+    int status = 0;
+    if (!found) {
+        printError("Invalid name: '%s'. File '%s' does not exist", argv[2], rename_paths[0]);
+        status = 1;
+    } else if (taken != NULL) {
+        printError("Invalid name: '%s'. File '%s' already exists", argv[3], taken);
+        status = 1;
+    }
+
+    for (size_t i = 0; status == 0 && i < extensions_size; i++) {
+        if (exists[i] && rename(rename_paths[i], new_paths[i])) {
+            printError("%s", strerror(errno));
+            status = 1;
+        }
+    }
+    if (status == 0 && migrateRenameLegacy(argv[2], argv[3])) {
+        printError("Could not rename '%s' in '%s'", argv[2], VAULT_LEGACY);
+        status = 1;
+    }
+
+    for (size_t i = 0; i < extensions_size; i++) {
+        free(rename_paths[i]);
+        free(new_paths[i]);
+    }
+    return status;
+}
+
+int cmdUpdate(const int argc, const char **argv)
+{
+    if (argc != 3) {
+        printError("Incorrect arguments for subcommand 'UPDATE'");
         return 1;
     }
 
-    char *new_path = getNewPath(getConfigPath(), argv[3], EXTENSION_LOCKED);
-    if (!stat(new_path, &st)) {
-        printError("Invalid name: '%s'. File '%s' already exists", argv[3], new_path);
-        free(new_path);
+    mkConfigDir();
+
+    char *update_path = getNewPath(getConfigPath(), argv[2], EXTENSION_LOCKED);
+    struct stat st;
+    if (stat(update_path, &st)) {
+        printError("Invalid name: '%s'. File '%s' does not exist", argv[2], update_path);
+        free(update_path);
         return 1;
     }
 
-    if (rename(rename_path, new_path)) {
-        printError("%s", strerror(errno));
+    size_t nonce_size = crypto_secretbox_NONCEBYTES;
+    size_t old_ciphertext_size;
+    size_t key_size = crypto_secretbox_KEYBYTES;
+    unsigned char key[key_size];
+    unsigned char nonce[nonce_size];
+    unsigned char *old_ciphertext = NULL;
+
+    FILE *fptr = fopen(update_path, "r");
+    if (fptr == NULL || readData(fptr, nonce, nonce_size, &old_ciphertext, &old_ciphertext_size)) {
+        printError("Could not read '%s'", update_path);
+        if (fptr != NULL) {
+            fclose(fptr);
+        }
+        free(update_path);
+        free(old_ciphertext);
         return 1;
     }
+    fclose(fptr);
 
-    return 0;
+    char *plaintext = getPassPhrase("Enter new password: ");
+    char *password = getPassPhrase("Master password: ");
+
+    size_t password_len = strlen(password);
+    size_t plaintext_len = strlen(plaintext);
+    size_t old_plaintext_len = old_ciphertext_size - crypto_secretbox_MACBYTES;
+    size_t ciphertext_size = crypto_secretbox_MACBYTES + plaintext_len;
+    unsigned char ciphertext[ciphertext_size];
+    unsigned char old_decrypted[old_plaintext_len];
+
+    if (sodium_init() < 0) {
+        printError("Sodium could not init in '%s'", __func__);
+        memWipe(plaintext, sizeof(*plaintext) * plaintext_len);
+        memWipe(password, sizeof(*password) * password_len);
+        free(update_path);
+        free(old_ciphertext);
+        free(plaintext);
+        free(password);
+        return 1;
+    }
+
+    VaultKey vault_key;
+    int locked = vaultKeyUnlock(&vault_key, password, password_len, 0);
+    memWipe(password, sizeof(*password) * password_len);
+    free(password);
+
+    if (locked || vaultKeyOpen(&vault_key, old_decrypted, old_ciphertext, old_ciphertext_size, nonce)) {
+        printError("Decryption failed. Master password does not match '%s'", argv[2]);
+        memWipe(&vault_key, sizeof(vault_key));
+        memWipe(plaintext, sizeof(*plaintext) * plaintext_len);
+        free(update_path);
+        free(old_ciphertext);
+        free(plaintext);
+        return 1;
+    }
+    memWipe(old_decrypted, sizeof(*old_decrypted) * old_plaintext_len);
+    free(old_ciphertext);
+
+    char *history_path = getNewPath(getConfigPath(), argv[2], EXTENSION_HISTORY);
+    if (appendHistory(update_path, history_path)) {
+        printError("Could not write history '%s'", history_path);
+        memWipe(&vault_key, sizeof(vault_key));
+        memWipe(plaintext, sizeof(*plaintext) * plaintext_len);
+        memWipe(key, key_size);
+        free(update_path);
+        free(history_path);
+        free(plaintext);
+        return 1;
+    }
+
+    randombytes_buf(nonce, sizeof(nonce));
+    vaultKeyDerive(&vault_key, nonce, key, key_size);
+    memWipe(&vault_key, sizeof(vault_key));
+    crypto_secretbox_easy(ciphertext, (unsigned char *)plaintext, plaintext_len, nonce, key);
+
+    int failed = writeDataToFile(update_path, nonce, nonce_size, ciphertext, ciphertext_size);
+    if (failed) {
+        printError("Could not write '%s'", update_path);
+    }
+
+    memWipe(plaintext, sizeof(*plaintext) * plaintext_len);
+    memWipe(key, key_size);
+    free(update_path);
+    free(history_path);
+    free(plaintext);
+    return failed;
+}
+
+int cmdHistory(const int argc, const char **argv)
+{
+    if (argc != 3) {
+        printError("Incorrect arguments for subcommand 'HISTORY'");
+        return 1;
+    }
+
+    mkConfigDir();
+
+    char *locked_path = getNewPath(getConfigPath(), argv[2], EXTENSION_LOCKED);
+    struct stat st;
+    if (stat(locked_path, &st)) {
+        printError("Invalid name: '%s'. File '%s' does not exist", argv[2], locked_path);
+        free(locked_path);
+        return 1;
+    }
+
+    char date[64];
+    printf("History of '%s':\n", argv[2]);
+
+    char *history_path = getNewPath(getConfigPath(), argv[2], EXTENSION_HISTORY);
+    size_t count = countHistory(history_path);
+    FILE *fptr = count > 0 ? fopen(history_path, "r") : NULL;
+    char *line = NULL;
+    size_t line_len = 0;
+    size_t start = count > HISTORY_MAX ? count - HISTORY_MAX : 0;
+    if (fptr != NULL) {
+        skipLines(fptr, start * HISTORY_RECORD_LINES);
+    }
+    for (size_t i = start; fptr != NULL && i < count; i++) {
+        if (getline(&line, &line_len, fptr) == -1) {
+            break;
+        }
+        time_t created = strtol(line, NULL, 10);
+        strftime(date, sizeof(date), "%F %T", localtime(&created));
+        printf("\t"ITALIC_BOLD_BLUE"%s@%zu"COLOR_RESET"\t%s\n", argv[2], count - i, date);
+        skipLines(fptr, HISTORY_RECORD_LINES - 1);
+    }
+    if (fptr != NULL) {
+        fclose(fptr);
+    }
+    strftime(date, sizeof(date), "%F %T", localtime(&st.st_mtime));
+    printf("\t"ITALIC_BOLD_BLUE"%s@0"COLOR_RESET"\t%s (current)\n", argv[2], date);
+
+    free(line);
+    free(locked_path);
+    free(history_path);
+    return 0;
+}
+
+int serveIndexCompare(const void *a, const void *b)
+{
+    return strcmp(((const ServeEntry *) a)->name, ((const ServeEntry *) b)->name);
+}
+
+void serveIndexFree(ServeIndex *index)
+{
+    for (size_t i = 0; i < index->entries_size; i++) {
+        free(index->entries[i].name);
+        free(index->entries[i].ciphertext);
+    }
+    free(index->entries);
+    index->entries = NULL;
+    index->entries_size = 0;
+    index->entries_cap = 0;
+}
+
+int serveIndexAdd(VaultFile *file, void *ctx)
+{
+    ServeIndex *index = ctx;
+    if (index->entries_size == index->entries_cap) {
+        index->entries_cap = index->entries_cap == 0 ? VAULT_BATCH : index->entries_cap * 2;
+        index->entries = reallocarray(index->entries, index->entries_cap, sizeof(*index->entries));
+    }
+    ServeEntry *entry = &index->entries[index->entries_size++];
+    memset(entry, 0, sizeof(*entry));
+    entry->name = strdup(file->name);
+
+    if (file->error != 0 || file->data_len == 0) {
+        return 0;
+    }
+    FILE *fptr = fmemopen(file->data, file->data_len, "r");
+    if (fptr == NULL) {
+        return 0;
+    }
+    if (readData(fptr, entry->nonce, sizeof(entry->nonce), &entry->ciphertext, &entry->ciphertext_size)) {
+        free(entry->ciphertext);
+        entry->ciphertext = NULL;
+    } else {
+        entry->loaded = 1;
+    }
+    fclose(fptr);
+    return 0;
+}
+
+int serveIndexBuild(ServeIndex *index, const char *config_path)
+{
+    serveIndexFree(index);
+
+    int status = vaultScan(config_path, EXTENSION_LOCKED, serveIndexAdd, index);
+    qsort(index->entries, index->entries_size, sizeof(*index->entries), serveIndexCompare);
+    return status;
+}
+
+ServeEntry *serveIndexFind(ServeIndex *index, const char *config_path, const char *name)
+{
+    ServeEntry key = { .name = (char *) name };
+    ServeEntry *entry = bsearch(&key, index->entries, index->entries_size, sizeof(*index->entries), serveIndexCompare);
+    if (entry == NULL || entry->loaded) {
+        return entry;
+    }
+
+    char *path = getNewPath(config_path, name, EXTENSION_LOCKED);
+    FILE *fptr = fopen(path, "r");
+    free(path);
+    if (fptr == NULL) {
+        return NULL;
+    }
+    if (readData(fptr, entry->nonce, sizeof(entry->nonce), &entry->ciphertext, &entry->ciphertext_size)) {
+        fclose(fptr);
+        free(entry->ciphertext);
+        entry->ciphertext = NULL;
+        return NULL;
+    }
+    fclose(fptr);
+    entry->loaded = 1;
+    return entry;
+}
+
+size_t serveIndexLowerBound(const ServeIndex *index, const char *name)
+{
+    size_t low = 0, high = index->entries_size;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (strcmp(index->entries[mid].name, name) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void serveIndexInvalidate(ServeIndex *index, const char *name)
+{
+    size_t i = serveIndexLowerBound(index, name);
+    if (i < index->entries_size && !strcmp(index->entries[i].name, name)) {
+        free(index->entries[i].ciphertext);
+        index->entries[i].ciphertext = NULL;
+        index->entries[i].loaded = 0;
+        return;
+    }
+
+    if (index->entries_size == index->entries_cap) {
+        index->entries_cap = index->entries_cap == 0 ? VAULT_BATCH : index->entries_cap * 2;
+        index->entries = reallocarray(index->entries, index->entries_cap, sizeof(*index->entries));
+    }
+    memmove(&index->entries[i + 1], &index->entries[i], (index->entries_size - i) * sizeof(*index->entries));
+    memset(&index->entries[i], 0, sizeof(index->entries[i]));
+    index->entries[i].name = strdup(name);
+    index->entries_size++;
+}
+
+void serveIndexRemove(ServeIndex *index, const char *name)
+{
+    size_t i = serveIndexLowerBound(index, name);
+    if (i == index->entries_size || strcmp(index->entries[i].name, name)) {
+        return;
+    }
+
+    free(index->entries[i].name);
+    free(index->entries[i].ciphertext);
+    index->entries_size--;
+    memmove(&index->entries[i], &index->entries[i + 1], (index->entries_size - i) * sizeof(*index->entries));
+}
+
+void serveIndexWatch(ServeState *state)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    while ((n = read(state->inotify_fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event *) p)->len) {
+            struct inotify_event *event = (struct inotify_event *) p;
+            if (event->mask & IN_Q_OVERFLOW) {
+                serveIndexBuild(&state->index, state->config_path);
+                continue;
+            }
+            if (event->len == 0 || !hasExtension(event->name, EXTENSION_LOCKED)) {
+                continue;
+            }
+
+            char name[NAME_MAX + 1];
+            snprintf(name, sizeof(name), "%.*s", (int) (strlen(event->name) - strlen(EXTENSION_LOCKED)), event->name);
+            if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                serveIndexRemove(&state->index, name);
+            } else {
+                serveIndexInvalidate(&state->index, name);
+            }
+        }
+    }
+}
+
+void serveAppend(ServeClient *client, const char *data, size_t len)
+{
+    if (client->out_len + len > client->out_cap) {
+        size_t capacity = client->out_cap == 0 ? SERVE_REQUEST_MAX : client->out_cap;
+        while (capacity < client->out_len + len) {
+            capacity *= 2;
+        }
+        char *out = (char *) malloc(capacity);
+        if (client->out != NULL) {
+            memcpy(out, client->out, client->out_len);
+            memWipe(client->out, client->out_cap);
+            free(client->out);
+        }
+        client->out = out;
+        client->out_cap = capacity;
+    }
+    memcpy(client->out + client->out_len, data, len);
+    client->out_len += len;
+}
+
+void serveAppendJsonString(ServeClient *client, const char *str, size_t len)
+{
+    char escaped[8];
+    serveAppend(client, "\"", 1);
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = str[i];
+        if (c == '"' || c == '\\') {
+            escaped[0] = '\\';
+            escaped[1] = c;
+            serveAppend(client, escaped, 2);
+        } else if (c < 0x20) {
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            serveAppend(client, escaped, 6);
+        } else {
+            serveAppend(client, (const char *) &c, 1);
+        }
+    }
+    memWipe(escaped, sizeof(escaped));
+    serveAppend(client, "\"", 1);
+}
+
+void serveAppendHead(ServeClient *client, const char *id)
+{
+    serveAppend(client, "{\"jsonrpc\":\"2.0\",\"id\":", 22);
+    serveAppend(client, id, strlen(id));
+}
+
+void serveAppendError(ServeClient *client, const char *id, int code, const char *message)
+{
+    char error[64];
+    serveAppendHead(client, id);
+    int len = snprintf(error, sizeof(error), ",\"error\":{\"code\":%d,\"message\":", code);
+    serveAppend(client, error, len);
+    serveAppendJsonString(client, message, strlen(message));
+    serveAppend(client, "}}\n", 3);
+}
+
+const char *jsonFindKey(const char *json, const char *key)
+{
+    size_t key_len = strlen(key);
+    const char *p = json;
+    while ((p = strchr(p, '"')) != NULL) {
+        if (!strncmp(p + 1, key, key_len) && p[key_len + 1] == '"') {
+            const char *value = p + key_len + 2;
+            while (*value == ' ' || *value == '\t') {
+                value++;
+            }
+            if (*value == ':') {
+                value++;
+                while (*value == ' ' || *value == '\t') {
+                    value++;
+                }
+                return value;
+            }
+        }
+        p++;
+    }
+    return NULL;
+}
+
+int jsonGetString(const char *json, const char *key, char *out, size_t out_size)
+{
+    const char *value = jsonFindKey(json, key);
+    if (value == NULL || *value != '"') {
+        return 1;
+    }
+
+    size_t len = 0;
+    for (value++; *value != '"'; value++) {
+        if (*value == '\0' || len + 1 >= out_size) {
+            return 1;
+        }
+        if (*value == '\\') {
+            value++;
+            if (*value != '"' && *value != '\\' && *value != '/') {
+                return 1;
+            }
+        }
+        out[len++] = *value;
+    }
+    out[len] = '\0';
+    return 0;
+}
+
+void jsonGetId(const char *json, char *out, size_t out_size)
+{
+    const char *value = jsonFindKey(json, "id");
+    size_t len = 0;
+    if (value != NULL && *value == '"') {
+        out[len++] = *value++;
+        while (*value != '\0' && *value != '"' && *value != '\\' && len + 2 < out_size) {
+            out[len++] = *value++;
+        }
+        if (*value != '"') {
+            len = 0;
+        } else {
+            out[len++] = '"';
+        }
+    } else if (value != NULL) {
+        while ((*value == '-' || (*value >= '0' && *value <= '9')) && len + 1 < out_size) {
+            out[len++] = *value++;
+        }
+    }
+    if (len == 0) {
+        snprintf(out, out_size, "null");
+        return;
+    }
+    out[len] = '\0';
+}
+
+void serveBucketRefill(ServeBucket *bucket, long rate)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - bucket->last.tv_sec) + (now.tv_nsec - bucket->last.tv_nsec) / 1e9;
+    bucket->last = now;
+    bucket->tokens += elapsed * rate;
+    if (bucket->tokens > rate * SERVE_BURST_SECONDS) {
+        bucket->tokens = rate * SERVE_BURST_SECONDS;
+    }
+}
+
+ServeBucket *serveBucketAcquire(ServeState *state, pid_t pid)
+{
+    ServeBucket *bucket = NULL;
+    for (size_t i = 0; i < SERVE_BUCKETS_MAX; i++) {
+        ServeBucket *candidate = &state->buckets[i];
+        if (candidate->pid == pid) {
+            bucket = candidate;
+            break;
+        } else if (bucket == NULL && candidate->clients == 0) {
+            serveBucketRefill(candidate, state->rate);
+            if (candidate->pid == 0 || candidate->tokens >= state->rate * SERVE_BURST_SECONDS) {
+                bucket = candidate;
+            }
+        }
+    }
+    if (bucket == NULL) {
+        return NULL;
+    }
+
+    if (bucket->pid != pid) {
+        bucket->pid = pid;
+        bucket->tokens = state->rate * SERVE_BURST_SECONDS;
+        clock_gettime(CLOCK_MONOTONIC, &bucket->last);
+    }
+    bucket->clients++;
+    return bucket;
+}
+
+int serveRateLimit(ServeBucket *bucket, long rate)
+{
+    if (rate == 0) {
+        return 0;
+    }
+
+    serveBucketRefill(bucket, rate);
+    if (bucket->tokens < 1) {
+        return 1;
+    }
+    bucket->tokens--;
+    return 0;
+}
+
+void serveHandleGet(ServeState *state, ServeClient *client, const char *request, const char *id)
+{
+    char name[FILENAME_MAX];
+    if (jsonGetString(request, "name", name, sizeof(name))) {
+        serveAppendError(client, id, -32602, "Missing 'name' parameter");
+        return;
+    }
+
+    ServeEntry *entry = serveIndexFind(&state->index, state->config_path, name);
+    if (entry == NULL) {
+        serveAppendError(client, id, -32001, "No such password");
+        return;
+    }
+
+    size_t plaintext_len = entry->ciphertext_size - crypto_secretbox_MACBYTES;
+    unsigned char *decrypted = (unsigned char *) malloc(plaintext_len + 1);
+    if (vaultKeyOpen(&state->key, decrypted, entry->ciphertext, entry->ciphertext_size, entry->nonce)) {
+        free(decrypted);
+        serveAppendError(client, id, -32002, "Decryption failed");
+        return;
+    }
+
+    serveAppendHead(client, id);
+    serveAppend(client, ",\"result\":", 10);
+    serveAppendJsonString(client, (const char *) decrypted, plaintext_len);
+    serveAppend(client, "}\n", 2);
+
+    memWipe(decrypted, plaintext_len);
+    free(decrypted);
+}
+
+void serveHandleList(ServeState *state, ServeClient *client, const char *id)
+{
+    serveAppendHead(client, id);
+    serveAppend(client, ",\"result\":[", 11);
+    for (size_t i = 0; i < state->index.entries_size; i++) {
+        if (i > 0) {
+            serveAppend(client, ",", 1);
+        }
+        serveAppendJsonString(client, state->index.entries[i].name, strlen(state->index.entries[i].name));
+    }
+    serveAppend(client, "]}\n", 3);
+}
+
+void serveHandleRequest(ServeState *state, ServeClient *client, const char *request)
+{
+    char id[SERVE_ID_MAX];
+    char method[32];
+    jsonGetId(request, id, sizeof(id));
+
+    if (serveRateLimit(client->bucket, state->rate)) {
+        serveAppendError(client, id, -32000, "Rate limit exceeded");
+    } else if (jsonGetString(request, "method", method, sizeof(method))) {
+        serveAppendError(client, id, -32600, "Invalid request");
+    } else if (!strcmp(method, "get")) {
+        serveHandleGet(state, client, request, id);
+    } else if (!strcmp(method, "list")) {
+        serveHandleList(state, client, id);
+    } else {
+        serveAppendError(client, id, -32601, "Method not found");
+    }
+}
+
+void serveClientClose(ServeState *state, ServeClient *client)
+{
+    epoll_ctl(state->epfd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    client->bucket->clients--;
+    memWipe(client->in, sizeof(client->in));
+    if (client->out != NULL) {
+        memWipe(client->out, client->out_cap);
+        free(client->out);
+    }
+    free(client);
+    state->clients_size--;
+}
+
+int serveClientFlush(ServeState *state, ServeClient *client)
+{
+    while (client->out_sent < client->out_len) {
+        ssize_t n = send(client->fd, client->out + client->out_sent, client->out_len - client->out_sent, MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else if (n < 0) {
+            return 1;
+        }
+        client->out_sent += n;
+    }
+
+    struct epoll_event ev = { .data.ptr = client };
+    if (client->closing && servePending(client) == 0 && strchr(client->in, '\n') == NULL) {
+        return 1;
+    } else if (client->closing || servePending(client) >= SERVE_OUTPUT_MAX) {
+        ev.events = EPOLLOUT;
+    } else if (servePending(client) > 0) {
+        ev.events = EPOLLIN | EPOLLOUT;
+    } else {
+        memWipe(client->out, client->out_len);
+        client->out_len = 0;
+        client->out_sent = 0;
+        ev.events = EPOLLIN;
+    }
+    if (ev.events != client->events) {
+        client->events = ev.events;
+        epoll_ctl(state->epfd, EPOLL_CTL_MOD, client->fd, &ev);
+    }
+    return 0;
+}
+
+size_t servePending(const ServeClient *client)
+{
+    return client->out_len - client->out_sent;
+}
+
+void serveClientProcess(ServeState *state, ServeClient *client)
+{
+    char *start = client->in;
+    char *newline;
+    while (servePending(client) < SERVE_OUTPUT_MAX && (newline = strchr(start, '\n')) != NULL) {
+        *newline = '\0';
+        if (newline > start) {
+            serveHandleRequest(state, client, start);
+        }
+        start = newline + 1;
+    }
+    client->in_len -= start - client->in;
+    memmove(client->in, start, client->in_len);
+    memWipe(client->in + client->in_len, sizeof(client->in) - client->in_len);
+}
+
+int serveClientRead(ServeState *state, ServeClient *client)
+{
+    serveClientProcess(state, client);
+    while (!client->closing && servePending(client) < SERVE_OUTPUT_MAX) {
+        ssize_t n = recv(client->fd, client->in + client->in_len, sizeof(client->in) - client->in_len - 1, 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else if (n < 0) {
+            return 1;
+        } else if (n == 0) {
+            client->closing = 1;
+            break;
+        }
+        client->in_len += n;
+        client->in[client->in_len] = '\0';
+
+        serveClientProcess(state, client);
+        if (client->in_len == sizeof(client->in) - 1 && servePending(client) < SERVE_OUTPUT_MAX) {
+            serveAppendError(client, "null", -32600, "Request too large");
+            serveClientFlush(state, client);
+            return 1;
+        }
+    }
+    return serveClientFlush(state, client);
+}
+
+void serveAccept(ServeState *state)
+{
+    int fd;
+    while ((fd = accept4(state->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        struct ucred cred;
+        socklen_t cred_len = sizeof(cred);
+        if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len)) {
+            printInfo("Rejected client: %s\n", strerror(errno));
+            close(fd);
+            continue;
+        } else if (cred.uid != getuid()) {
+            printInfo("Rejected client with uid %d\n", (int) cred.uid);
+            close(fd);
+            continue;
+        }
+        ServeBucket *bucket = state->clients_size < SERVE_CLIENTS_MAX ? serveBucketAcquire(state, cred.pid) : NULL;
+        if (bucket == NULL) {
+            close(fd);
+            continue;
+        }
+
+        ServeClient *client = (ServeClient *) calloc(1, sizeof(*client));
+        client->fd = fd;
+        client->bucket = bucket;
+        client->events = EPOLLIN;
+
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = client };
+        epoll_ctl(state->epfd, EPOLL_CTL_ADD, fd, &ev);
+        state->clients_size++;
+    }
+}
+
+int serveListen(const char *socket_path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        printError("Socket path '%s' is too long", socket_path);
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        printError("%s", strerror(errno));
+        return -1;
+    }
+
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (!connect(probe, (struct sockaddr *) &addr, sizeof(addr))) {
+        printError("Another server is already listening on '%s'", socket_path);
+        close(probe);
+        close(fd);
+        return -1;
+    }
+    close(probe);
+    unlink(socket_path);
+
+    mode_t old_mask = umask(0077);
+    int failed = bind(fd, (struct sockaddr *) &addr, sizeof(addr)) || listen(fd, SOMAXCONN);
+    umask(old_mask);
+    if (failed) {
+        printError("%s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static volatile sig_atomic_t serve_running = 1;
+
+void serveStop(int sig)
+{
+    UNUSED(sig);
+    serve_running = 0;
+}
+
+int cmdServe(const int argc, const char **argv)
+{
+    if (argc != 2 && argc != 3) {
+        printError("Incorrect arguments for subcommand 'SERVE'");
+        return 1;
+    }
+
+    ServeState state = { .rate = SERVE_RATE };
+    if (argc == 3) {
+        char *end;
+        state.rate = strtol(argv[2], &end, 10);
+        if (argv[2][0] == '\0' || *end != '\0' || state.rate < 0) {
+            printError("Invalid rate: '%s'", argv[2]);
+            return 1;
+        }
+    }
+
+    mkConfigDir();
+
+    state.config_path = getConfigPath();
+    if (serveIndexBuild(&state.index, state.config_path)) {
+        printError("Could not read '%s'", state.config_path);
+        free(state.config_path);
+        serveIndexFree(&state.index);
+        return 1;
+    }
+
+    char *password = getPassPhrase("Master password: ");
+    size_t password_len = strlen(password);
+
+    if (sodium_init() < 0) {
+        printError("Sodium could not init in '%s'", __func__);
+        memWipe(password, sizeof(*password) * password_len);
+        free(password);
+        free(state.config_path);
+        serveIndexFree(&state.index);
+        return 1;
+    }
+
+    mlock(&state.key, sizeof(state.key));
+    int locked = vaultKeyUnlock(&state.key, password, password_len, 0);
+    memWipe(password, sizeof(*password) * password_len);
+    free(password);
+
+    if (locked) {
+        printError("Decryption failed");
+        memWipe(&state.key, sizeof(state.key));
+        free(state.config_path);
+        serveIndexFree(&state.index);
+        return 1;
+    } else if (state.key.legacy && state.index.entries_size > 0) {
+        int failed = 1;
+        for (size_t i = 0; failed && i < state.index.entries_size; i++) {
+            ServeEntry *entry = serveIndexFind(&state.index, state.config_path, state.index.entries[i].name);
+            if (entry == NULL) {
+                continue;
+            }
+            unsigned char *decrypted = (unsigned char *) malloc(entry->ciphertext_size);
+            failed = vaultKeyOpen(&state.key, decrypted, entry->ciphertext, entry->ciphertext_size, entry->nonce);
+            memWipe(decrypted, entry->ciphertext_size);
+            free(decrypted);
+        }
+        if (failed) {
+            printError("Decryption failed");
+            memWipe(&state.key, sizeof(state.key));
+            free(state.config_path);
+            serveIndexFree(&state.index);
+            return 1;
+        }
+    }
+
+    char *socket_path = getNewPath(state.config_path, SERVE_SOCKET, "");
+    state.listen_fd = serveListen(socket_path);
+    if (state.listen_fd < 0) {
+        memWipe(&state.key, sizeof(state.key));
+        free(socket_path);
+        free(state.config_path);
+        serveIndexFree(&state.index);
+        return 1;
+    }
+
+    state.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    inotify_add_watch(state.inotify_fd, state.config_path, IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+
+    state.epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &state.listen_fd };
+    epoll_ctl(state.epfd, EPOLL_CTL_ADD, state.listen_fd, &ev);
+    ev.data.ptr = &state.inotify_fd;
+    epoll_ctl(state.epfd, EPOLL_CTL_ADD, state.inotify_fd, &ev);
+
+    struct sigaction sa = { .sa_handler = serveStop };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printInfo("Serving %zu passwords on '%s'\n", state.index.entries_size, socket_path);
+
+    struct epoll_event events[SERVE_EVENTS_MAX];
+    while (serve_running) {
+        int n = epoll_wait(state.epfd, events, SERVE_EVENTS_MAX, -1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            printError("%s", strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == &state.listen_fd) {
+                serveAccept(&state);
+            } else if (events[i].data.ptr == &state.inotify_fd) {
+                serveIndexWatch(&state);
+            } else {
+                ServeClient *client = events[i].data.ptr;
+                int failed = 0;
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    failed = 1;
+                }
+                if (!failed && (events[i].events & EPOLLOUT)) {
+                    failed = serveClientFlush(&state, client);
+                }
+                if (!failed && (events[i].events & EPOLLOUT) && servePending(client) < SERVE_OUTPUT_MAX && strchr(client->in, '\n') != NULL) {
+                    failed = serveClientRead(&state, client);
+                }
+                if (!failed && (events[i].events & EPOLLIN)) {
+                    failed = serveClientRead(&state, client);
+                }
+                if (failed) {
+                    serveClientClose(&state, client);
+                }
+            }
+        }
+    }
+
+    printInfo("Shutting down\n");
+    close(state.epfd);
+    close(state.inotify_fd);
+    close(state.listen_fd);
+    unlink(socket_path);
+    memWipe(&state.key, sizeof(state.key));
+    free(socket_path);
+    free(state.config_path);
+    serveIndexFree(&state.index);
+    return 0;
+}
+
+ssize_t readFull(int fd, unsigned char *buf, size_t len)
+{
+    size_t total = 0;
+    while (total < len) {
+        ssize_t n = read(fd, buf + total, len - total);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            return -1;
+        } else if (n == 0) {
+            break;
+        }
+        total += n;
+    }
+    return total;
+}
+
+int writeFull(int fd, const unsigned char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            return 1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int attachEncrypt(int in_fd, int out_fd, const VaultKey *vault_key)
+{
+    crypto_secretstream_xchacha20poly1305_state state;
+    unsigned char id[VAULT_KEY_ID_BYTES];
+    unsigned char header[crypto_secretstream_xchacha20poly1305_HEADERBYTES];
+    unsigned char key[crypto_secretstream_xchacha20poly1305_KEYBYTES];
+    unsigned char *plain = (unsigned char *) malloc(ATTACHMENT_CHUNK);
+    unsigned char *cipher = (unsigned char *) malloc(ATTACHMENT_CHUNK + crypto_secretstream_xchacha20poly1305_ABYTES);
+    int status = 0;
+
+    posix_fadvise(in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    randombytes_buf(id, sizeof(id));
+    vaultKeyDerive(vault_key, id, key, sizeof(key));
+    crypto_secretstream_xchacha20poly1305_init_push(&state, header, key);
+    memWipe(key, sizeof(key));
+    if ((!vault_key->legacy && writeFull(out_fd, id, sizeof(id))) || writeFull(out_fd, header, sizeof(header))) {
+        status = 1;
+    }
+
+    unsigned char tag = 0;
+    while (status == 0 && tag != crypto_secretstream_xchacha20poly1305_TAG_FINAL) {
+        ssize_t n = readFull(in_fd, plain, ATTACHMENT_CHUNK);
+        if (n < 0) {
+            status = 1;
+            break;
+        }
+        tag = n < ATTACHMENT_CHUNK ? crypto_secretstream_xchacha20poly1305_TAG_FINAL : crypto_secretstream_xchacha20poly1305_TAG_MESSAGE;
+
+        unsigned long long cipher_len;
+        crypto_secretstream_xchacha20poly1305_push(&state, cipher, &cipher_len, plain, n, NULL, 0, tag);
+        memWipe(plain, n);
+        if (writeFull(out_fd, cipher, cipher_len)) {
+            status = 1;
+        }
+    }
+
+    memWipe(&state, sizeof(state));
+    free(plain);
+    free(cipher);
+    return status;
+}
+
+int attachDecrypt(int in_fd, int out_fd, const VaultKey *vault_key)
+{
+    crypto_secretstream_xchacha20poly1305_state state;
+    unsigned char id[VAULT_KEY_ID_BYTES];
+    unsigned char header[crypto_secretstream_xchacha20poly1305_HEADERBYTES];
+    unsigned char key[crypto_secretstream_xchacha20poly1305_KEYBYTES];
+    const size_t cipher_chunk = ATTACHMENT_CHUNK + crypto_secretstream_xchacha20poly1305_ABYTES;
+
+    posix_fadvise(in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    if ((!vault_key->legacy && readFull(in_fd, id, sizeof(id)) != sizeof(id))
+            || readFull(in_fd, header, sizeof(header)) != sizeof(header)) {
+        printError("Attachment is truncated");
+        return 1;
+    }
+    vaultKeyDerive(vault_key, id, key, sizeof(key));
+    int failed = crypto_secretstream_xchacha20poly1305_init_pull(&state, header, key) != 0;
+    memWipe(key, sizeof(key));
+    if (failed) {
+        printError("Decryption failed");
+        return 1;
+    }
+
+    unsigned char *plain = (unsigned char *) malloc(ATTACHMENT_CHUNK);
+    unsigned char *cipher = (unsigned char *) malloc(cipher_chunk);
+    unsigned char tag = 0;
+    int status = 0;
+
+    while (status == 0 && tag != crypto_secretstream_xchacha20poly1305_TAG_FINAL) {
+        ssize_t n = readFull(in_fd, cipher, cipher_chunk);
+        unsigned long long plain_len;
+        if (n < 0) {
+            printError("%s", strerror(errno));
+            status = 1;
+        } else if (n < crypto_secretstream_xchacha20poly1305_ABYTES) {
+            printError("Attachment is truncated");
+            status = 1;
+        } else if (crypto_secretstream_xchacha20poly1305_pull(&state, plain, &plain_len, &tag, cipher, n, NULL, 0) != 0) {
+            printError("Decryption failed");
+            status = 1;
+        } else if (tag != crypto_secretstream_xchacha20poly1305_TAG_FINAL && (size_t) n < cipher_chunk) {
+            printError("Attachment is truncated");
+            status = 1;
+        } else if (tag == crypto_secretstream_xchacha20poly1305_TAG_FINAL && readFull(in_fd, cipher, 1) != 0) {
+            printError("Attachment has trailing data");
+            status = 1;
+        } else if (writeFull(out_fd, plain, plain_len)) {
+            printError("%s", strerror(errno));
+            status = 1;
+        }
+        memWipe(plain, ATTACHMENT_CHUNK);
+    }
+
+    memWipe(&state, sizeof(state));
+    free(plain);
+    free(cipher);
+    return status;
+}
+
+int cmdAttach(const int argc, const char **argv)
+{
+    if (argc != 4) {
+        printError("Incorrect arguments for subcommand 'ATTACH'");
+        return 1;
+    }
+
+    mkConfigDir();
+
+    char *attach_path = getNewPath(getConfigPath(), argv[2], EXTENSION_ATTACHMENT);
+    struct stat st;
+    if (!stat(attach_path, &st)) {
+        printError("Invalid name: '%s'. File '%s' already exists", argv[2], attach_path);
+        free(attach_path);
+        return 1;
+    }
+
+    char *locked_path = getNewPath(getConfigPath(), argv[2], EXTENSION_LOCKED);
+    if (!stat(locked_path, &st)) {
+        printError("Invalid name: '%s'. File '%s' already exists", argv[2], locked_path);
+        free(attach_path);
+        free(locked_path);
+        return 1;
+    }
+    free(locked_path);
+
+    int in_fd = open(argv[3], O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0) {
+        printError("Could not open '%s': %s", argv[3], strerror(errno));
+        free(attach_path);
+        return 1;
+    }
+
+    char *password = getPassPhrase("Master password: ");
+    size_t password_len = strlen(password);
+    VaultKey vault_key;
+
+    if (sodium_init() < 0) {
+        printError("Sodium could not init in '%s'", __func__);
+        memWipe(password, sizeof(*password) * password_len);
+        free(password);
+        free(attach_path);
+        close(in_fd);
+        return 1;
+    }
+
+    int locked = vaultKeyUnlock(&vault_key, password, password_len, 1);
+    memWipe(password, sizeof(*password) * password_len);
+    free(password);
+    if (!locked && vault_key.legacy) {
+        char *config_path = getConfigPath();
+        locked = vaultKeyCheck(&vault_key, config_path);
+        free(config_path);
+    }
+    if (locked) {
+        printError("Decryption failed. Master password does not match the existing entries");
+        memWipe(&vault_key, sizeof(vault_key));
+        free(attach_path);
+        close(in_fd);
+        return 1;
+    }
+
+    char tmp_path[FILENAME_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s%s", attach_path, EXTENSION_TMP);
+    int out_fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (out_fd < 0) {
+        printError("Could not open '%s': %s", tmp_path, strerror(errno));
+        memWipe(&vault_key, sizeof(vault_key));
+        free(attach_path);
+        close(in_fd);
+        return 1;
+    }
+
+    int status = attachEncrypt(in_fd, out_fd, &vault_key);
+    memWipe(&vault_key, sizeof(vault_key));
+    close(in_fd);
+    if (status || fsync(out_fd) || close(out_fd) || rename(tmp_path, attach_path)) {
+        printError("Could not write '%s': %s", attach_path, strerror(errno));
+        unlink(tmp_path);
+        free(attach_path);
+        return 1;
+    }
+
+    free(attach_path);
+    return 0;
+}
+
+int cmdExtract(const int argc, const char **argv)
+{
+    if (argc != 3) {
+        printError("Incorrect arguments for subcommand 'EXTRACT'");
+        return 1;
+    }
+
+    mkConfigDir();
+
+    char *extract_path = getNewPath(getConfigPath(), argv[2], EXTENSION_ATTACHMENT);
+    int in_fd = open(extract_path, O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0) {
+        printError("Invalid name: '%s'. File '%s' does not exist", argv[2], extract_path);
+        free(extract_path);
+        return 1;
+    }
+
+    char *password = getPassPhrase("Master password: ");
+    size_t password_len = strlen(password);
+    VaultKey vault_key;
+
+    if (sodium_init() < 0) {
+        printError("Sodium could not init in '%s'", __func__);
+        memWipe(password, sizeof(*password) * password_len);
+        free(password);
+        free(extract_path);
+        close(in_fd);
+        return 1;
+    }
+
+    int locked = vaultKeyUnlock(&vault_key, password, password_len, 0);
+    memWipe(password, sizeof(*password) * password_len);
+    free(password);
+
+    int status = 1;
+    if (locked) {
+        printError("Decryption failed");
+    } else if (vault_key.fallback && attachProbe(in_fd, &vault_key)) {
+        VaultKey legacy_key;
+        vaultKeyLegacy(&vault_key, &legacy_key);
+        status = attachDecrypt(in_fd, STDOUT_FILENO, &legacy_key);
+        memWipe(&legacy_key, sizeof(legacy_key));
+    } else {
+        status = attachDecrypt(in_fd, STDOUT_FILENO, &vault_key);
+    }
+
+    memWipe(&vault_key, sizeof(vault_key));
+    close(in_fd);
+    free(extract_path);
+    return status;
+}
+
+int vaultRingInit(VaultRing *ring, unsigned entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        return 1;
+    }
+
+    ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_size > ring->sq_size) {
+            ring->sq_size = ring->cq_size;
+        }
+        ring->cq_size = ring->sq_size;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        close(ring->fd);
+        return 1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            munmap(ring->sq_ptr, ring->sq_size);
+            close(ring->fd);
+            return 1;
+        }
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cq_ptr != ring->sq_ptr) {
+            munmap(ring->cq_ptr, ring->cq_size);
+        }
+        munmap(ring->sq_ptr, ring->sq_size);
+        close(ring->fd);
+        return 1;
+    }
+
+    unsigned char *sq = ring->sq_ptr;
+    unsigned char *cq = ring->cq_ptr;
+    ring->sq_head = (unsigned *) (sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) (sq + params.sq_off.array);
+    ring->cq_head = (unsigned *) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+    ring->sq_entries = params.sq_entries;
+    return 0;
+}
+
+void vaultRingFree(VaultRing *ring)
+{
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_size);
+    }
+    munmap(ring->sq_ptr, ring->sq_size);
+    close(ring->fd);
+}
+
+struct io_uring_sqe *vaultRingSqe(VaultRing *ring, VaultOp op, size_t i)
+{
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = (i << 2) | op;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->pending++;
+    return sqe;
+}
+
+int vaultRingWait(VaultRing *ring, VaultFile *files)
+{
+    unsigned submitted = 0;
+    unsigned to_submit = ring->pending;
+    unsigned reaped = 0;
+
+    while (reaped < ring->pending) {
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail || submitted < to_submit) {
+            int n = syscall(__NR_io_uring_enter, ring->fd, to_submit - submitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+            if (n < 0 && errno != EINTR) {
+                ring->inflight = submitted - reaped;
+                ring->pending = 0;
+                return 1;
+            } else if (n > 0) {
+                submitted += n;
+            }
+            continue;
+        }
+
+        for (; head != tail; head++, reaped++) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            VaultFile *file = &files[cqe->user_data >> 2];
+            switch ((VaultOp) (cqe->user_data & 3)) {
+            case VAULT_OP_OPEN:
+                file->fd = cqe->res;
+                break;
+            case VAULT_OP_STATX:
+            case VAULT_OP_READ:
+            case VAULT_OP_CLOSE:
+                if (cqe->res < 0 && file->error == 0) {
+                    file->error = -cqe->res;
+                } else if ((cqe->user_data & 3) == VAULT_OP_READ && cqe->res >= 0) {
+                    file->data_len = cqe->res;
+                }
+                break;
+            }
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    ring->pending = 0;
+    return 0;
+}
+
+int vaultRingBatch(VaultRing *ring, VaultFile *files, size_t files_size)
+{
+    for (size_t i = 0; i < files_size; i++) {
+        struct io_uring_sqe *sqe = vaultRingSqe(ring, VAULT_OP_OPEN, i);
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uintptr_t) files[i].path;
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+
+        sqe = vaultRingSqe(ring, VAULT_OP_STATX, i);
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uintptr_t) files[i].path;
+        sqe->len = STATX_SIZE | STATX_MTIME;
+        sqe->off = (uintptr_t) &files[i].stx;
+    }
+    if (vaultRingWait(ring, files)) {
+        return 1;
+    }
+
+    for (size_t i = 0; i < files_size; i++) {
+        if (files[i].fd == -EINVAL) {
+            return 1;
+        } else if (files[i].fd < 0) {
+            files[i].error = -files[i].fd;
+            continue;
+        } else if (files[i].error != 0) {
+            continue;
+        } else if (files[i].stx.stx_size > VAULT_READ_MAX) {
+            files[i].error = EFBIG;
+            continue;
+        }
+
+        files[i].data = (unsigned char *) malloc(files[i].stx.stx_size + 1);
+        struct io_uring_sqe *sqe = vaultRingSqe(ring, VAULT_OP_READ, i);
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = files[i].fd;
+        sqe->addr = (uintptr_t) files[i].data;
+        sqe->len = files[i].stx.stx_size;
+        sqe->off = 0;
+    }
+    if (vaultRingWait(ring, files)) {
+        return 1;
+    }
+
+    for (size_t i = 0; i < files_size; i++) {
+        if (files[i].fd >= 0) {
+            struct io_uring_sqe *sqe = vaultRingSqe(ring, VAULT_OP_CLOSE, i);
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = files[i].fd;
+            files[i].fd = -1;
+        }
+    }
+    return vaultRingWait(ring, files);
+}
+
+void vaultReadFile(VaultFile *file)
+{
+    int fd = open(file->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        file->error = errno;
+        return;
+    }
+    if (statx(fd, "", AT_EMPTY_PATH, STATX_SIZE | STATX_MTIME, &file->stx)) {
+        file->error = errno;
+    } else if (file->stx.stx_size > VAULT_READ_MAX) {
+        file->error = EFBIG;
+    } else {
+        file->data = (unsigned char *) malloc(file->stx.stx_size + 1);
+        ssize_t n = readFull(fd, file->data, file->stx.stx_size);
+        if (n < 0) {
+            file->error = errno;
+        } else {
+            file->data_len = n;
+        }
+    }
+    close(fd);
+}
+
+void vaultReadWork(void *item, void *ctx)
+{
+    UNUSED(ctx);
+    vaultReadFile(item);
+}
+
+void workPoolDrain(WorkPool *pool)
+{
+    while (pool->next < pool->items_size) {
+        void *item = pool->items + pool->next++ * pool->item_size;
+        pthread_mutex_unlock(&pool->lock);
+        pool->callback(item, pool->ctx);
+        pthread_mutex_lock(&pool->lock);
+    }
+}
+
+void *workPoolThread(void *arg)
+{
+    WorkPool *pool = arg;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->stop && pool->generation == seen) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->stop) {
+            break;
+        }
+        seen = pool->generation;
+        workPoolDrain(pool);
+        if (--pool->busy == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+void workPoolInit(WorkPool *pool)
+{
+    memset(pool, 0, sizeof(*pool));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for (; pool->threads_size < VAULT_THREADS; pool->threads_size++) {
+        if (pthread_create(&pool->threads[pool->threads_size], NULL, workPoolThread, pool)) {
+            break;
+        }
+    }
+}
+
+void workPoolRun(WorkPool *pool, void *items, size_t item_size, size_t items_size, WorkCallback callback, void *ctx)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->items = items;
+    pool->item_size = item_size;
+    pool->items_size = items_size;
+    pool->callback = callback;
+    pool->ctx = ctx;
+    pool->next = 0;
+    pool->busy = pool->threads_size;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+
+    workPoolDrain(pool);
+    while (pool->busy > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void workPoolFree(WorkPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (size_t i = 0; i < pool->threads_size; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+int vaultScan(const char *dir_path, const char *extension, VaultCallback callback, void *ctx)
+{
+    DIR *dir = opendir(dir_path);
+    if (dir == NULL) {
+        return 1;
+    }
+
+    char **names = NULL;
+    size_t names_size = 0, capacity = 0;
+    struct dirent *entity;
+    while ((entity = readdir(dir)) != NULL) {
+        if (!hasExtension(entity->d_name, extension)) {
+            continue;
+        }
+        if (names_size == capacity) {
+            capacity = capacity == 0 ? VAULT_BATCH : capacity * 2;
+            names = reallocarray(names, capacity, sizeof(*names));
+        }
+        names[names_size++] = strndup(entity->d_name, strlen(entity->d_name) - strlen(extension));
+    }
+    closedir(dir);
+
+    VaultRing ring;
+    WorkPool pool;
+    int use_ring = names_size > 0 && !vaultRingInit(&ring, VAULT_BATCH * 2);
+    int use_pool = 0;
+    VaultFile *files = (VaultFile *) calloc(VAULT_BATCH, sizeof(*files));
+    int status = 0;
+
+    for (size_t start = 0; status == 0 && start < names_size; start += VAULT_BATCH) {
+        size_t files_size = names_size - start < VAULT_BATCH ? names_size - start : VAULT_BATCH;
+        for (size_t i = 0; i < files_size; i++) {
+            memset(&files[i], 0, sizeof(files[i]));
+            files[i].name = names[start + i];
+            files[i].path = getNewPath(dir_path, files[i].name, extension);
+            files[i].fd = -1;
+        }
+
+        if (use_ring && vaultRingBatch(&ring, files, files_size)) {
+            if (ring.inflight > 0) {
+                printError("io_uring failed with %u requests in flight", ring.inflight);
+                vaultRingFree(&ring);
+                use_ring = 0;
+                files = NULL;
+                status = 1;
+                break;
+            }
+            for (size_t i = 0; i < files_size; i++) {
+                if (files[i].fd >= 0) {
+                    close(files[i].fd);
+                }
+                free(files[i].data);
+                memset(&files[i].stx, 0, sizeof(files[i].stx));
+                files[i].data = NULL;
+                files[i].data_len = 0;
+                files[i].error = 0;
+            }
+            vaultRingFree(&ring);
+            use_ring = 0;
+        }
+        if (!use_ring && !use_pool) {
+            workPoolInit(&pool);
+            use_pool = 1;
+        }
+        if (use_pool) {
+            workPoolRun(&pool, files, sizeof(*files), files_size, vaultReadWork, NULL);
+        }
+
+        for (size_t i = 0; i < files_size; i++) {
+            if (status == 0 && callback(&files[i], ctx)) {
+                status = 1;
+            }
+            if (files[i].data != NULL) {
+                memWipe(files[i].data, files[i].data_len);
+                free(files[i].data);
+            }
+            free(files[i].path);
+        }
+    }
+
+    if (use_ring) {
+        vaultRingFree(&ring);
+    }
+    if (use_pool) {
+        workPoolFree(&pool);
+    }
+    free(files);
+    for (size_t i = 0; i < names_size; i++) {
+        free(names[i]);
+    }
+    free(names);
+    return status;
+}
+
+int vaultHeaderWrite(const char *path, const char *password, size_t password_len, const unsigned char *master_key)
+{
+    unsigned char salt[crypto_pwhash_SALTBYTES];
+    unsigned char wrap_key[crypto_secretbox_KEYBYTES];
+    unsigned char nonce[crypto_secretbox_NONCEBYTES];
+    unsigned char wrapped[crypto_secretbox_MACBYTES + crypto_kdf_KEYBYTES];
+    unsigned long long opslimit = crypto_pwhash_OPSLIMIT_INTERACTIVE;
+    size_t memlimit = crypto_pwhash_MEMLIMIT_INTERACTIVE;
+
+    randombytes_buf(salt, sizeof(salt));
+    if (crypto_pwhash(wrap_key, sizeof(wrap_key), password, password_len, salt, opslimit, memlimit, crypto_pwhash_ALG_DEFAULT) != 0) {
+        return 1;
+    }
+    randombytes_buf(nonce, sizeof(nonce));
+    crypto_secretbox_easy(wrapped, master_key, crypto_kdf_KEYBYTES, nonce, wrap_key);
+    memWipe(wrap_key, sizeof(wrap_key));
+
+    char tmp_path[FILENAME_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s%s", path, EXTENSION_TMP);
+    FILE *fptr = fopen(tmp_path, "w");
+    if (fptr == NULL) {
+        return 1;
+    }
+    fchmod(fileno(fptr), 0600);
+    fprintf(fptr, "%llu %zu\n", opslimit, memlimit);
+    writeHex(fptr, salt, sizeof(salt));
+    writeData(fptr, nonce, sizeof(nonce), wrapped, sizeof(wrapped));
+
+    if (fflush(fptr) || fsync(fileno(fptr)) || fclose(fptr) || rename(tmp_path, path)) {
+        unlink(tmp_path);
+        return 1;
+    }
+    return 0;
+}
+
+int vaultHeaderRead(const char *path, const char *password, size_t password_len, unsigned char *master_key)
+{
+    FILE *fptr = fopen(path, "r");
+    if (fptr == NULL) {
+        return 1;
+    }
+
+    char *line = NULL;
+    size_t line_len = 0;
+    unsigned long long opslimit;
+    size_t memlimit;
+    unsigned char salt[crypto_pwhash_SALTBYTES];
+    unsigned char nonce[crypto_secretbox_NONCEBYTES];
+    unsigned char *wrapped = NULL;
+    size_t wrapped_size;
+    int status = 1;
+
+    if (getline(&line, &line_len, fptr) != -1 && sscanf(line, "%llu %zu", &opslimit, &memlimit) == 2
+            && getline(&line, &line_len, fptr) != -1) {
+        readHexFromStr(salt, sizeof(salt), line);
+        if (!readData(fptr, nonce, sizeof(nonce), &wrapped, &wrapped_size)
+                && wrapped_size == crypto_secretbox_MACBYTES + crypto_kdf_KEYBYTES) {
+            unsigned char wrap_key[crypto_secretbox_KEYBYTES];
+            if (crypto_pwhash(wrap_key, sizeof(wrap_key), password, password_len, salt, opslimit, memlimit, crypto_pwhash_ALG_DEFAULT) == 0
+                    && crypto_secretbox_open_easy(master_key, wrapped, wrapped_size, nonce, wrap_key) == 0) {
+                status = 0;
+            }
+            memWipe(wrap_key, sizeof(wrap_key));
+        }
+    }
+
+    fclose(fptr);
+    free(line);
+    free(wrapped);
+    return status;
+}
+
+int vaultIsEmpty(const char *config_path)
+{
+    DIR *dir = opendir(config_path);
+    if (dir == NULL) {
+        return 1;
+    }
+
+    int empty = 1;
+    struct dirent *entity;
+    while (empty && (entity = readdir(dir)) != NULL) {
+        if (hasExtension(entity->d_name, EXTENSION_LOCKED) || hasExtension(entity->d_name, EXTENSION_ATTACHMENT)) {
+            empty = 0;
+        }
+    }
+    closedir(dir);
+    return empty;
+}
+
+int vaultKeyUnlock(VaultKey *vault_key, const char *password, size_t password_len, int create)
+{
+    char *config_path = getConfigPath();
+    char *header_path = getNewPath(config_path, VAULT_HEADER, "");
+    char *pending_path = getNewPath(config_path, VAULT_HEADER, EXTENSION_PENDING);
+    char *legacy_path = getNewPath(config_path, VAULT_LEGACY, "");
+    struct stat st;
+    int status = 0;
+
+    memWipe(vault_key, sizeof(*vault_key));
+    crypto_generichash(vault_key->legacy_key, sizeof(vault_key->legacy_key), (unsigned char *)password, password_len, NULL, 0);
+    if (!stat(header_path, &st)) {
+        status = vaultHeaderRead(header_path, password, password_len, vault_key->key);
+        vault_key->fallback = !stat(legacy_path, &st);
+    } else if (!stat(pending_path, &st)) {
+        status = vaultHeaderRead(pending_path, password, password_len, vault_key->key);
+        vault_key->fallback = 1;
+        if (status == 0) {
+            printInfo("Migration is incomplete. Run `%s migrate` to finish it\n", program.name);
+        }
+    } else if (create && vaultIsEmpty(config_path)) {
+        crypto_kdf_keygen(vault_key->key);
+        if (vaultHeaderWrite(header_path, password, password_len, vault_key->key)) {
+            printError("Could not write vault header '%s'", header_path);
+            status = 1;
+        }
+    } else {
+        vault_key->legacy = 1;
+        memcpy(vault_key->key, vault_key->legacy_key, sizeof(vault_key->key));
+    }
+
+    free(legacy_path);
+    free(pending_path);
+    free(header_path);
+    free(config_path);
+    return status;
+}
+
+void vaultKeyDerive(const VaultKey *vault_key, const unsigned char *id, unsigned char *key, size_t key_size)
+{
+    if (vault_key->legacy) {
+        memcpy(key, vault_key->key, key_size);
+        return;
+    }
+
+    uint64_t subkey_id = 0;
+    for (size_t i = 0; i < VAULT_KEY_ID_BYTES; i++) {
+        subkey_id |= (uint64_t) id[i] << (8 * i);
+    }
+    crypto_kdf_derive_from_key(key, key_size, subkey_id, VAULT_KDF_CONTEXT, vault_key->key);
+}
+
+int vaultKeyOpen(const VaultKey *vault_key, unsigned char *decrypted, const unsigned char *ciphertext, size_t ciphertext_size, const unsigned char *nonce)
+{
+    unsigned char key[crypto_secretbox_KEYBYTES];
+    vaultKeyDerive(vault_key, nonce, key, sizeof(key));
+    int failed = crypto_secretbox_open_easy(decrypted, ciphertext, ciphertext_size, nonce, key) != 0;
+    if (failed && vault_key->fallback) {
+        failed = crypto_secretbox_open_easy(decrypted, ciphertext, ciphertext_size, nonce, vault_key->legacy_key) != 0;
+    }
+    memWipe(key, sizeof(key));
+    return failed;
+}
+
+void vaultKeyLegacy(const VaultKey *vault_key, VaultKey *legacy_key)
+{
+    memWipe(legacy_key, sizeof(*legacy_key));
+    legacy_key->legacy = 1;
+    memcpy(legacy_key->key, vault_key->legacy_key, sizeof(legacy_key->key));
+}
+
+int vaultKeyCheck(const VaultKey *vault_key, const char *config_path)
+{
+    DIR *dir = opendir(config_path);
+    if (dir == NULL) {
+        return 1;
+    }
+
+    int checked = 0, failed = 1;
+    struct dirent *entity;
+    while (failed && (entity = readdir(dir)) != NULL) {
+        char *path = getNewPath(config_path, entity->d_name, "");
+        if (hasExtension(entity->d_name, EXTENSION_LOCKED)) {
+            unsigned char nonce[crypto_secretbox_NONCEBYTES];
+            unsigned char *ciphertext = NULL;
+            size_t ciphertext_size;
+            FILE *fptr = fopen(path, "r");
+            if (fptr != NULL && !readData(fptr, nonce, sizeof(nonce), &ciphertext, &ciphertext_size)) {
+                unsigned char *decrypted = (unsigned char *) malloc(ciphertext_size);
+                failed = vaultKeyOpen(vault_key, decrypted, ciphertext, ciphertext_size, nonce);
+                memWipe(decrypted, ciphertext_size);
+                free(decrypted);
+            }
+            if (fptr != NULL) {
+                fclose(fptr);
+            }
+            free(ciphertext);
+            checked = 1;
+        } else if (hasExtension(entity->d_name, EXTENSION_ATTACHMENT)) {
+            int fd = open(path, O_RDONLY | O_CLOEXEC);
+            if (fd >= 0) {
+                failed = attachProbe(fd, vault_key);
+                close(fd);
+            }
+            checked = 1;
+        }
+        free(path);
+    }
+    closedir(dir);
+    return checked && failed;
+}
+
+FILE *migrateOpen(const MigrateFile *file)
+{
+    if (file->data != NULL && file->data_len > 0) {
+        return fmemopen(file->data, file->data_len, "r");
+    }
+    return fopen(file->path, "r");
+}
+
+int migrateRecords(MigrateFile *file, const VaultKey *legacy_key, const VaultKey *vault_key)
+{
+    FILE *in = migrateOpen(file);
+    if (in == NULL) {
+        return 1;
+    }
+
+    char tmp_path[FILENAME_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s%s", file->path, EXTENSION_TMP);
+    FILE *out = fopen(tmp_path, "w");
+    if (out == NULL) {
+        fclose(in);
+        return 1;
+    }
+    fchmod(fileno(out), 0600);
+
+    char *line = NULL;
+    size_t line_len = 0;
+    int status = 0;
+    for (int first = 1; status == 0; first = 0) {
+        if (file->has_timestamp) {
+            if (getline(&line, &line_len, in) == -1) {
+                break;
+            }
+            fputs(line, out);
+        } else if (!first) {
+            break;
+        }
+
+        unsigned char nonce[crypto_secretbox_NONCEBYTES];
+        unsigned char key[crypto_secretbox_KEYBYTES];
+        unsigned char *ciphertext = NULL;
+        size_t ciphertext_size;
+        if (readData(in, nonce, sizeof(nonce), &ciphertext, &ciphertext_size)) {
+            free(ciphertext);
+            status = 1;
+            break;
+        }
+
+        size_t plaintext_len = ciphertext_size - crypto_secretbox_MACBYTES;
+        unsigned char *plaintext = (unsigned char *) malloc(plaintext_len + 1);
+        vaultKeyDerive(legacy_key, nonce, key, sizeof(key));
+        if (crypto_secretbox_open_easy(plaintext, ciphertext, ciphertext_size, nonce, key) != 0) {
+            vaultKeyDerive(vault_key, nonce, key, sizeof(key));
+            if (crypto_secretbox_open_easy(plaintext, ciphertext, ciphertext_size, nonce, key) != 0) {
+                status = 1;
+            }
+        }
+
+        if (status == 0) {
+            randombytes_buf(nonce, sizeof(nonce));
+            vaultKeyDerive(vault_key, nonce, key, sizeof(key));
+            crypto_secretbox_easy(ciphertext, plaintext, plaintext_len, nonce, key);
+            writeData(out, nonce, sizeof(nonce), ciphertext, ciphertext_size);
+        }
+
+        memWipe(plaintext, plaintext_len);
+        memWipe(key, sizeof(key));
+        free(plaintext);
+        free(ciphertext);
+    }
+    fclose(in);
+    free(line);
+
+    if (fflush(out) || fsync(fileno(out)) || fclose(out) || status || rename(tmp_path, file->path)) {
+        unlink(tmp_path);
+        return 1;
+    }
+    return 0;
+}
+
+int attachProbe(int fd, const VaultKey *vault_key)
+{
+    crypto_secretstream_xchacha20poly1305_state state;
+    unsigned char id[VAULT_KEY_ID_BYTES];
+    unsigned char header[crypto_secretstream_xchacha20poly1305_HEADERBYTES];
+    unsigned char key[crypto_secretstream_xchacha20poly1305_KEYBYTES];
+    const size_t cipher_chunk = ATTACHMENT_CHUNK + crypto_secretstream_xchacha20poly1305_ABYTES;
+    unsigned char *cipher = (unsigned char *) malloc(cipher_chunk);
+    unsigned char *plain = (unsigned char *) malloc(ATTACHMENT_CHUNK);
+    unsigned long long plain_len;
+    unsigned char tag;
+    int status = 1;
+
+    lseek(fd, 0, SEEK_SET);
+    if ((vault_key->legacy || readFull(fd, id, sizeof(id)) == sizeof(id))
+            && readFull(fd, header, sizeof(header)) == sizeof(header)) {
+        vaultKeyDerive(vault_key, id, key, sizeof(key));
+        ssize_t n = readFull(fd, cipher, cipher_chunk);
+        if (n >= crypto_secretstream_xchacha20poly1305_ABYTES
+                && crypto_secretstream_xchacha20poly1305_init_pull(&state, header, key) == 0
+                && crypto_secretstream_xchacha20poly1305_pull(&state, plain, &plain_len, &tag, cipher, n, NULL, 0) == 0) {
+            status = 0;
+        }
+    }
+    lseek(fd, 0, SEEK_SET);
+
+    memWipe(plain, ATTACHMENT_CHUNK);
+    memWipe(key, sizeof(key));
+    memWipe(&state, sizeof(state));
+    free(plain);
+    free(cipher);
+    return status;
+}
+
+void *migrateAttachmentWriter(void *arg)
+{
+    MigratePipe *pipe = arg;
+    pipe->status = attachEncrypt(pipe->in_fd, pipe->out_fd, pipe->vault_key);
+    close(pipe->in_fd);
+    return NULL;
+}
+
+int migrateAttachment(MigrateFile *file, const VaultKey *legacy_key, const VaultKey *vault_key)
+{
+    int in_fd = open(file->path, O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0) {
+        return 1;
+    }
+
+    const VaultKey *old_key = legacy_key;
+    if (attachProbe(in_fd, legacy_key)) {
+        old_key = vault_key;
+        if (attachProbe(in_fd, vault_key)) {
+            close(in_fd);
+            return 1;
+        }
+    }
+
+    char tmp_path[FILENAME_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s%s", file->path, EXTENSION_TMP);
+    int out_fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    int fds[2];
+    if (out_fd < 0 || pipe2(fds, O_CLOEXEC)) {
+        if (out_fd >= 0) {
+            close(out_fd);
+            unlink(tmp_path);
+        }
+        close(in_fd);
+        return 1;
+    }
+
+    MigratePipe writer = { .in_fd = fds[0], .out_fd = out_fd, .vault_key = vault_key };
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, migrateAttachmentWriter, &writer)) {
+        close(fds[0]);
+        close(fds[1]);
+        close(out_fd);
+        close(in_fd);
+        unlink(tmp_path);
+        return 1;
+    }
+    int status = attachDecrypt(in_fd, fds[1], old_key);
+    close(fds[1]);
+    pthread_join(thread, NULL);
+    close(in_fd);
+
+    if (status || writer.status || fsync(out_fd) || close(out_fd) || rename(tmp_path, file->path)) {
+        unlink(tmp_path);
+        return 1;
+    }
+    return 0;
+}
+
+int migrateCheck(MigrateFile *file, const VaultKey *legacy_key, const VaultKey *vault_key)
+{
+    if (file->is_attachment) {
+        int fd = open(file->path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return 1;
+        }
+        int status = attachProbe(fd, legacy_key) && attachProbe(fd, vault_key);
+        close(fd);
+        return status;
+    }
+
+    FILE *fptr = migrateOpen(file);
+    if (fptr == NULL) {
+        return 1;
+    }
+    if (file->has_timestamp) {
+        skipLines(fptr, 1);
+    }
+
+    unsigned char nonce[crypto_secretbox_NONCEBYTES];
+    unsigned char key[crypto_secretbox_KEYBYTES];
+    unsigned char *ciphertext = NULL;
+    size_t ciphertext_size;
+    int status = 1;
+    if (!readData(fptr, nonce, sizeof(nonce), &ciphertext, &ciphertext_size)) {
+        size_t plaintext_len = ciphertext_size - crypto_secretbox_MACBYTES;
+        unsigned char *plaintext = (unsigned char *) malloc(plaintext_len + 1);
+        vaultKeyDerive(legacy_key, nonce, key, sizeof(key));
+        status = crypto_secretbox_open_easy(plaintext, ciphertext, ciphertext_size, nonce, key) != 0;
+        if (status) {
+            vaultKeyDerive(vault_key, nonce, key, sizeof(key));
+            status = crypto_secretbox_open_easy(plaintext, ciphertext, ciphertext_size, nonce, key) != 0;
+        }
+        memWipe(plaintext, plaintext_len);
+        memWipe(key, sizeof(key));
+        free(plaintext);
+    }
+    fclose(fptr);
+    free(ciphertext);
+    return status;
+}
+
+void migrateWork(void *item, void *ctx)
+{
+    MigrateFile *file = item;
+    MigrateKeys *keys = ctx;
+    if (file->is_attachment) {
+        file->status = migrateAttachment(file, keys->legacy_key, keys->vault_key);
+    } else {
+        file->status = migrateRecords(file, keys->legacy_key, keys->vault_key);
+    }
+}
+
+void migrateBaseName(const char *path, char *name, size_t name_size)
+{
+    const char *base = strrchr(path, '/');
+    base = base == NULL ? path : base + 1;
+    snprintf(name, name_size, "%.*s", (int) (strrchr(base, '.') - base), base);
+}
+
+int migrateWriteLegacy(const char *legacy_path, const MigrateFile *files, size_t files_size)
+{
+    char tmp_path[FILENAME_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s%s", legacy_path, EXTENSION_TMP);
+    FILE *fptr = fopen(tmp_path, "w");
+    if (fptr == NULL) {
+        return 1;
+    }
+    for (size_t i = 0; i < files_size; i++) {
+        char name[FILENAME_MAX], other[FILENAME_MAX];
+        migrateBaseName(files[i].path, name, sizeof(name));
+        int listed = 0;
+        for (size_t j = 0; files[i].status && !listed && j < i; j++) {
+            migrateBaseName(files[j].path, other, sizeof(other));
+            listed = files[j].status && !strcmp(name, other);
+        }
+        if (files[i].status && !listed) {
+            fprintf(fptr, "%s\n", name);
+        }
+    }
+    if (fflush(fptr) || fsync(fileno(fptr)) || fclose(fptr) || rename(tmp_path, legacy_path)) {
+        unlink(tmp_path);
+        return 1;
+    }
+    return 0;
+}
+
+char **migrateReadLegacy(const char *legacy_path, size_t *names_size)
+{
+    FILE *fptr = fopen(legacy_path, "r");
+    char **names = NULL;
+    size_t capacity = 0;
+    *names_size = 0;
+    if (fptr == NULL) {
+        return NULL;
+    }
+
+    char *line = NULL;
+    size_t line_len = 0;
+    while (getline(&line, &line_len, fptr) != -1) {
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] == '\0') {
+            continue;
+        }
+        if (*names_size == capacity) {
+            capacity = capacity == 0 ? VAULT_BATCH : capacity * 2;
+            names = reallocarray(names, capacity, sizeof(*names));
+        }
+        names[(*names_size)++] = strdup(line);
+    }
+    free(line);
+    fclose(fptr);
+    return names;
+}
+
+int migrateListed(char **names, size_t names_size, const char *name)
+{
+    for (size_t i = 0; i < names_size; i++) {
+        if (!strcmp(names[i], name)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+MigrateFile *migrateAdd(MigrateList *list, const char *path, const char *name)
+{
+    if (list->retrying && !migrateListed(list->legacy_names, list->legacy_names_size, name)) {
+        return NULL;
+    }
+    if (list->files_size == list->capacity) {
+        list->capacity = list->capacity == 0 ? VAULT_BATCH : list->capacity * 2;
+        list->files = reallocarray(list->files, list->capacity, sizeof(*list->files));
+    }
+    MigrateFile *file = &list->files[list->files_size++];
+    *file = (MigrateFile) {
+        .path = strdup(path),
+        .has_timestamp = hasExtension(path, EXTENSION_HISTORY),
+        .is_attachment = hasExtension(path, EXTENSION_ATTACHMENT),
+    };
+    return file;
+}
+
+int migrateCollect(VaultFile *file, void *ctx)
+{
+    MigrateFile *migrate_file = migrateAdd(ctx, file->path, file->name);
+    if (migrate_file != NULL && file->error == 0) {
+        migrate_file->data = file->data;
+        migrate_file->data_len = file->data_len;
+        file->data = NULL;
+    }
+    return 0;
+}
+
+int migrateRenameLegacy(const char *from, const char *to)
+{
+    char *config_path = getConfigPath();
+    char *legacy_path = getNewPath(config_path, VAULT_LEGACY, "");
+    size_t names_size;
+    char **names = migrateReadLegacy(legacy_path, &names_size);
+    int status = 0;
+
+    if (migrateListed(names, names_size, from)) {
+        char tmp_path[FILENAME_MAX];
+        snprintf(tmp_path, sizeof(tmp_path), "%s%s", legacy_path, EXTENSION_TMP);
+        FILE *fptr = fopen(tmp_path, "w");
+        status = fptr == NULL;
+        for (size_t i = 0; fptr != NULL && i < names_size; i++) {
+            fprintf(fptr, "%s\n", strcmp(names[i], from) ? names[i] : to);
+        }
+        if (fptr != NULL && (fflush(fptr) || fsync(fileno(fptr)) || fclose(fptr) || rename(tmp_path, legacy_path))) {
+            unlink(tmp_path);
+            status = 1;
+        }
+    }
+
+    for (size_t i = 0; i < names_size; i++) {
+        free(names[i]);
+    }
+    free(names);
+    free(legacy_path);
+    free(config_path);
+    return status;
+}
+
+int cmdMigrate(const int argc, const char **argv)
+{
+    int force = argc == 3 && !strcmp(argv[2], "force");
+    if (argc != 2 && !force) {
+        printError("Incorrect arguments for subcommand 'MIGRATE'");
+        return 1;
+    }
+
+    mkConfigDir();
+
+    char *config_path = getConfigPath();
+    char *header_path = getNewPath(config_path, VAULT_HEADER, "");
+    char *pending_path = getNewPath(config_path, VAULT_HEADER, EXTENSION_PENDING);
+    char *legacy_path = getNewPath(config_path, VAULT_LEGACY, "");
+    struct stat st;
+    int retrying = !stat(header_path, &st);
+    if (retrying && stat(legacy_path, &st)) {
+        printError("'%s' already uses a vault header", config_path);
+        free(legacy_path);
+        free(pending_path);
+        free(header_path);
+        free(config_path);
+        return 1;
+    }
+
+    char *password = getPassPhrase("Master password: ");
+    size_t password_len = strlen(password);
+
+    if (sodium_init() < 0) {
+        printError("Sodium could not init in '%s'", __func__);
+        memWipe(password, sizeof(*password) * password_len);
+        free(password);
+        free(legacy_path);
+        free(pending_path);
+        free(header_path);
+        free(config_path);
+        return 1;
+    }
+
+    VaultKey legacy_key = { .legacy = 1 };
+    VaultKey vault_key = { .legacy = 0 };
+    crypto_generichash(legacy_key.key, sizeof(legacy_key.key), (unsigned char *)password, password_len, NULL, 0);
+
+    MigrateKeys keys = { .legacy_key = &legacy_key, .vault_key = &vault_key };
+    MigrateList list = { .retrying = retrying };
+    if (retrying) {
+        list.legacy_names = migrateReadLegacy(legacy_path, &list.legacy_names_size);
+    }
+    int scan_failed = vaultScan(config_path, EXTENSION_LOCKED, migrateCollect, &list)
+        || vaultScan(config_path, EXTENSION_HISTORY, migrateCollect, &list);
+
+    DIR *dir = opendir(config_path);
+    struct dirent *entity;
+    while ((entity = readdir(dir)) != NULL) {
+        if (hasExtension(entity->d_name, EXTENSION_ATTACHMENT)) {
+            char *path = getNewPath(config_path, entity->d_name, "");
+            char name[FILENAME_MAX];
+            migrateBaseName(path, name, sizeof(name));
+            migrateAdd(&list, path, name);
+            free(path);
+        }
+    }
+    closedir(dir);
+    MigrateFile *files = list.files;
+    size_t files_size = list.files_size;
+
+    int resuming = !retrying && !stat(pending_path, &st);
+    int failed;
+    if (scan_failed) {
+        printError("Could not read '%s'", config_path);
+        failed = 1;
+    } else if (retrying) {
+        failed = vaultHeaderRead(header_path, password, password_len, vault_key.key);
+    } else if (resuming) {
+        printInfo("Resuming interrupted migration\n");
+        failed = vaultHeaderRead(pending_path, password, password_len, vault_key.key);
+    } else {
+        crypto_kdf_keygen(vault_key.key);
+        failed = files_size > 0;
+        for (size_t i = 0; failed && i < files_size; i++) {
+            failed = migrateCheck(&files[i], &legacy_key, &vault_key);
+        }
+    }
+    if (!failed && !retrying && !resuming && vaultHeaderWrite(pending_path, password, password_len, vault_key.key)) {
+        printError("Could not write vault header '%s'", pending_path);
+        failed = 1;
+    } else if (failed && !scan_failed) {
+        printError("Decryption failed");
+    }
+    memWipe(password, sizeof(*password) * password_len);
+    free(password);
+
+    size_t errors = 0;
+    if (!failed) {
+        WorkPool pool;
+        workPoolInit(&pool);
+        workPoolRun(&pool, files, sizeof(*files), files_size, migrateWork, &keys);
+        workPoolFree(&pool);
+
+        for (size_t i = 0; i < files_size; i++) {
+            if (files[i].status) {
+                printError("Could not migrate '%s'", files[i].path);
+                errors++;
+            }
+        }
+    }
+    memWipe(&legacy_key, sizeof(legacy_key));
+    memWipe(&vault_key, sizeof(vault_key));
+
+    if (!failed && errors > 0 && !force && !retrying) {
+        printError("%zu of %zu files failed. Run `%s migrate` again to retry, or `%s migrate force` to leave them in the old format",
+                errors, files_size, program.name, program.name);
+        failed = 1;
+    } else if (!failed && errors > 0 && migrateWriteLegacy(legacy_path, files, files_size)) {
+        printError("Could not write '%s'", legacy_path);
+        failed = 1;
+    } else if (!failed && errors == 0 && !stat(legacy_path, &st) && unlink(legacy_path)) {
+        printError("%s", strerror(errno));
+        failed = 1;
+    } else if (!failed && !retrying && rename(pending_path, header_path)) {
+        printError("%s", strerror(errno));
+        failed = 1;
+    }
+
+    if (!failed && errors > 0) {
+        printInfo("%zu of %zu files are still in the old format and listed in '%s'. Run `%s migrate` again to retry\n",
+                errors, files_size, legacy_path, program.name);
+        failed = retrying && !force;
+    } else if (!failed) {
+        printInfo("Migrated %zu files to '%s'\n", files_size, header_path);
+    }
+
+    for (size_t i = 0; i < files_size; i++) {
+        if (files[i].data != NULL) {
+            memWipe(files[i].data, files[i].data_len);
+            free(files[i].data);
+        }
+        free(files[i].path);
+    }
+    free(files);
+    for (size_t i = 0; i < list.legacy_names_size; i++) {
+        free(list.legacy_names[i]);
+    }
+    free(list.legacy_names);
+    free(legacy_path);
+    free(pending_path);
+    free(header_path);
+    free(config_path);
+    return failed;
+}
+
+int cmdPasswd(const int argc, const char **argv)
+{
+    UNUSED(argv);
+
+    if (argc != 2) {
+        printError("Incorrect arguments for subcommand 'PASSWD'");
+        return 1;
+    }
+
+    mkConfigDir();
+
+    char *header_path = getNewPath(getConfigPath(), VAULT_HEADER, "");
+    char *legacy_path = getNewPath(getConfigPath(), VAULT_LEGACY, "");
+    struct stat st;
+    if (stat(header_path, &st)) {
+        printError("'%s' does not exist. Run `%s migrate` first", header_path, program.name);
+        free(legacy_path);
+        free(header_path);
+        return 1;
+    } else if (!stat(legacy_path, &st)) {
+        printError("Files listed in '%s' still use the master password directly. Run `%s migrate` first", legacy_path, program.name);
+        free(legacy_path);
+        free(header_path);
+        return 1;
+    }
+    free(legacy_path);
+
+    char *password = getPassPhrase("Master password: ");
+    size_t password_len = strlen(password);
+    unsigned char master_key[crypto_kdf_KEYBYTES];
+
+    if (sodium_init() < 0) {
+        printError("Sodium could not init in '%s'", __func__);
+        memWipe(password, sizeof(*password) * password_len);
+        free(password);
+        free(header_path);
+        return 1;
+    }
+
+    int failed = vaultHeaderRead(header_path, password, password_len, master_key);
+    memWipe(password, sizeof(*password) * password_len);
+    free(password);
+    if (failed) {
+        printError("Decryption failed");
+        memWipe(master_key, sizeof(master_key));
+        free(header_path);
+        return 1;
+    }
+
+    char *new_password = getPassPhrase("New master password: ");
+    char *confirm_password = getPassPhrase("Repeat new master password: ");
+    size_t new_password_len = strlen(new_password);
+    size_t confirm_password_len = strlen(confirm_password);
+
+    if (new_password_len == 0 || strcmp(new_password, confirm_password)) {
+        printError("Passwords do not match");
+        failed = 1;
+    } else if (vaultHeaderWrite(header_path, new_password, new_password_len, master_key)) {
+        printError("Could not write vault header '%s'", header_path);
+        failed = 1;
+    }
+
+    memWipe(new_password, sizeof(*new_password) * new_password_len);
+    memWipe(confirm_password, sizeof(*confirm_password) * confirm_password_len);
+    memWipe(master_key, sizeof(master_key));
+    free(new_password);
+    free(confirm_password);
+    free(header_path);
+    return failed;
 }
 
 int cmdBackup(const int argc, const char **argv)